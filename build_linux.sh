@@ -0,0 +1,13 @@
+#!/bin/sh
+
+mkdir -p build
+cd build
+
+compilerFlags="-O2 -g -std=c++11 -fno-exceptions -fno-rtti -fno-strict-aliasing -Wall -Werror -Wno-unused-variable -Wno-unused-but-set-variable -Wno-unused-function -Wno-write-strings -Wno-switch -Wno-endif-labels"
+linkerFlags="-pthread"
+
+g++ $compilerFlags ../code/linux_main.cpp -o linux_main $linkerFlags
+g++ $compilerFlags ../code/linux_bench.cpp -o linux_bench $linkerFlags
+g++ $compilerFlags ../code/linux_sat_bench.cpp -o linux_sat_bench $linkerFlags
+g++ $compilerFlags ../code/linux_queue_stress.cpp -o linux_queue_stress $linkerFlags
+g++ $compilerFlags ../code/linux_broadphase_bench.cpp -o linux_broadphase_bench $linkerFlags
@@ -3,6 +3,11 @@
 
 #define SHIP_SPEED_LIMIT 8
 #define BULLET_SPEED_LIMIT 16
+// NOTE(lvl5): add_asteroid stays under it, the swept bullet test looks
+// this far around the bullet for asteroids that move into its way
+#define ASTEROID_SPEED_LIMIT 12
+
+#define GRID_CELL_SIZE 2.5f
 
 /*
 
@@ -17,35 +22,6 @@ TODO:
 #define COLOR_RED v4(1, 0, 0, 1)
 
 
-rect2 polygon_to_aabb(Polygon poly)
-{
-  rect2 result = inverted_infinity_rect2();
-  for (u32 vertex_index = 0;
-       vertex_index < poly.count;
-       vertex_index++)
-  {
-    v2 v = poly.vertices[vertex_index];
-    if (v.x < result.min.x)
-    {
-      result.min.x = v.x;
-    }
-    if (v.y < result.min.y)
-    {
-      result.min.y = v.y;
-    }
-    if (v.x > result.max.x)
-    {
-      result.max.x = v.x;
-    }
-    if (v.y > result.max.y)
-    {
-      result.max.y = v.y;
-    }
-  }
-  
-  return result;
-}
-
 void push_transient_context(State *state)
 {
   LocalContext ctx = make_context(get_local_context());
@@ -217,112 +193,511 @@ Polygon generate_random_convex_polygon(RandomSequence *rand, u32 count, f32 scal
 }
 
 
-Entity *add_entity(State *state, EntityType type)
+EntityHandle make_entity_handle(u32 slot_index, u32 generation)
+{
+  assert(slot_index <= ENTITY_INDEX_MASK);
+  EntityHandle result = ((generation & ENTITY_GENERATION_MASK) << ENTITY_INDEX_BITS) |
+    slot_index;
+  return result;
+}
+
+u32 get_handle_slot_index(EntityHandle handle)
+{
+  u32 result = handle & ENTITY_INDEX_MASK;
+  return result;
+}
+
+u32 get_handle_generation(EntityHandle handle)
+{
+  u32 result = handle >> ENTITY_INDEX_BITS;
+  return result;
+}
+
+void push_permanent_context(State *state)
+{
+  LocalContext ctx = make_context(get_local_context());
+  ctx.allocator = arena_allocator;
+  ctx.allocator_data = &state->arena;
+  push_context(ctx);
+}
+
+void *alloc_entity_chunk(State *state, u64 size)
+{
+  void *result = 0;
+  push_permanent_context(state); {
+    result = alloc(size);
+  }pop_context();
+  return result;
+}
+
+EntitySlot *get_entity_slot(State *state, u32 slot_index)
+{
+  EntitySlots *slots = &state->entity_slots;
+  u32 chunk_index = slot_index >> ENTITY_CHUNK_SHIFT;
+  assert(chunk_index < slots->chunk_count);
+  EntitySlot *result = slots->chunks[chunk_index]->slots + (slot_index & ENTITY_CHUNK_MASK);
+  return result;
+}
+
+EntityHandle add_entity_slot(State *state, EntityType type, u32 dense_index)
 {
-  assert(state->entities_count < array_count(state->entities));
-  u32 index = state->entities_count++;
-  Entity *e = state->entities + index;
-  *e = {};
-  e->t.scale = v2(1, 1);
-  e->exists = true;
-  e->type = type;
-  e->is_temporary = false;
+  EntitySlots *slots = &state->entity_slots;
+  u32 slot_index = slots->first_free;
+  if (slot_index == ENTITY_SLOT_NONE)
+  {
+    // NOTE(lvl5): slot 0 is never handed out, see ENTITY_NULL_HANDLE
+    if (slots->count == 0)
+    {
+      slots->count = 1;
+    }
+    slot_index = slots->count++;
+    
+    u32 chunk_index = slot_index >> ENTITY_CHUNK_SHIFT;
+    assert(chunk_index < MAX_ENTITY_CHUNK_COUNT);
+    if (chunk_index == slots->chunk_count)
+    {
+      slots->chunks[slots->chunk_count++] =
+        (EntitySlotChunk *)alloc_entity_chunk(state, sizeof(EntitySlotChunk));
+    }
+    get_entity_slot(state, slot_index)->generation = 0;
+  }
+  else
+  {
+    slots->first_free = get_entity_slot(state, slot_index)->dense_index;
+  }
   
-  return e;
+  EntitySlot *slot = get_entity_slot(state, slot_index);
+  slot->dense_index = dense_index;
+  slot->type = type;
+  EntityHandle result = make_entity_handle(slot_index, slot->generation);
+  return result;
+}
+
+// NOTE(lvl5): handles stop resolving right away, the slot is reused only
+// after free_entity_slot
+void retire_entity_handle(State *state, EntityHandle handle)
+{
+  get_entity_slot(state, get_handle_slot_index(handle))->generation++;
+}
+
+void free_entity_slot(State *state, EntityHandle handle)
+{
+  EntitySlots *slots = &state->entity_slots;
+  u32 slot_index = get_handle_slot_index(handle);
+  get_entity_slot(state, slot_index)->dense_index = slots->first_free;
+  slots->first_free = slot_index;
+}
+
+void move_entity_slot(State *state, EntityHandle handle, u32 dense_index)
+{
+  get_entity_slot(state, get_handle_slot_index(handle))->dense_index = dense_index;
 }
 
-#define INVALID_ENTITY_INDEX 0
-b32 is_valid(u32 entity_index)
+b32 is_valid(State *state, EntityHandle handle)
 {
-  b32 result = entity_index == INVALID_ENTITY_INDEX;
+  b32 result = false;
+  u32 slot_index = get_handle_slot_index(handle);
+  if (handle != ENTITY_NULL_HANDLE && slot_index < state->entity_slots.count)
+  {
+    EntitySlot *slot = get_entity_slot(state, slot_index);
+    result = (slot->generation & ENTITY_GENERATION_MASK) == get_handle_generation(handle);
+  }
   return result;
 }
 
-Entity *get_entity(State *state, u32 entity_index)
+// NOTE(lvl5): false when the entity was removed since the handle was made
+b32 get_entity_index(State *state, EntityHandle handle, EntityType type, u32 *index)
 {
-  assert(entity_index != INVALID_ENTITY_INDEX);
-  Entity *result = 0;
-  Entity *test = state->entities + entity_index;
-  if (test->exists)
+  b32 result = false;
+  if (is_valid(state, handle))
   {
-    result = test;
+    EntitySlot *slot = get_entity_slot(state, get_handle_slot_index(handle));
+    if (slot->type == type)
+    {
+      *index = slot->dense_index;
+      result = true;
+    }
   }
   return result;
 }
 
-void remove_entity(State *state, Entity *e)
+b32 broadphase_is_ready(State *state)
+{
+  b32 result = state->query_pair_first != 0;
+  return result;
+}
+
+v2 wrap_position(v2 p, v2 area)
 {
-  u32 last_index = state->entities_count - 1;
-  Entity *last_entity = state->entities + last_index;
-  if (e != last_entity)
+  v2 half_area = area*0.5f;
+  v2 result = p;
+  if (result.x > half_area.x)
   {
-    *e = *last_entity;
+    result.x -= area.x;
   }
+  if (result.x < -half_area.x)
+  {
+    result.x += area.x;
+  }
+  if (result.y > half_area.y)
+  {
+    result.y -= area.y;
+  }
+  if (result.y < -half_area.y)
+  {
+    result.y += area.y;
+  }
+  return result;
+}
+
+// NOTE(lvl5): the world wraps around, so something sticking out of a side
+// of bounds also shows up shifted by area to the other side. offsets[0] is
+// always zero, the rest are the shifted copies, at most 8 of them
+#define MAX_WRAP_OFFSET_COUNT 9
+
+u32 get_wrap_offsets(rect2 aabb, rect2 bounds, v2 area, v2 *offsets)
+{
+  f32 x_offsets[3] = {0.0f};
+  u32 x_count = 1;
+  if (aabb.max.x > bounds.max.x)
+    x_offsets[x_count++] = -area.x;
+  if (aabb.min.x < bounds.min.x)
+    x_offsets[x_count++] = area.x;
+  
+  f32 y_offsets[3] = {0.0f};
+  u32 y_count = 1;
+  if (aabb.max.y > bounds.max.y)
+    y_offsets[y_count++] = -area.y;
+  if (aabb.min.y < bounds.min.y)
+    y_offsets[y_count++] = area.y;
   
-  state->entities_count--;
+  u32 result = 0;
+  for (u32 y_index = 0; y_index < y_count; y_index++)
+  {
+    for (u32 x_index = 0; x_index < x_count; x_index++)
+    {
+      offsets[result++] = v2(x_offsets[x_index], y_offsets[y_index]);
+    }
+  }
+  return result;
+}
+
+u32 count_wrap_copies(rect2 aabb, rect2 bounds, v2 area)
+{
+  v2 offsets[MAX_WRAP_OFFSET_COUNT];
+  u32 result = get_wrap_offsets(aabb, bounds, area, offsets) - 1;
+  return result;
+}
+
+void push_wrapped_shape(RenderGroup *group, ShapeIndex shape, Transform t, rect2 aabb,
+                        rect2 camera_rect, v2 area, v4 color)
+{
+  v2 offsets[MAX_WRAP_OFFSET_COUNT];
+  u32 offset_count = get_wrap_offsets(aabb, camera_rect, area, offsets);
+  for (u32 offset_index = 0; offset_index < offset_count; offset_index++)
+  {
+    push_shape(group, shape, translate(t, offsets[offset_index]), color);
+  }
+}
+
+void push_wrapped_shape_rect(RenderGroup *group, ShapeIndex shape, Transform t, rect2 aabb,
+                             rect2 camera_rect, v2 area, v4 color)
+{
+  v2 offsets[MAX_WRAP_OFFSET_COUNT];
+  u32 offset_count = get_wrap_offsets(aabb, camera_rect, area, offsets);
+  for (u32 offset_index = 0; offset_index < offset_count; offset_index++)
+  {
+    push_shape_rect(group, shape, translate(t, offsets[offset_index]), color);
+  }
+}
+
+
+rect2 get_world_aabb(State *state, ShapeIndex shape, Transform t)
+{
+  rect2 result = get_shape_aabb(get_shape(&state->shapes, shape), t);
+  return result;
+}
+
+// NOTE(lvl5): the normals only need rotating, and dividing by the scale
+// so they stay perpendicular when it isn't uniform. Their length doesn't
+// matter to the test
+SoaTransform get_soa_transform(Transform t)
+{
+  SoaTransform result;
+  result.m = transform_to_m2x3(t);
+  result.normal_m = make_m2x3(v2(), t.angle, v2(t.scale.y, t.scale.x));
+  return result;
+}
+
+
+// NOTE(lvl5): asteroids
+AsteroidChunk *get_asteroid_chunk(AsteroidArray *asteroids, u32 index)
+{
+  u32 chunk_index = index >> ENTITY_CHUNK_SHIFT;
+  assert(chunk_index < asteroids->chunk_count);
+  AsteroidChunk *result = asteroids->chunks[chunk_index];
+  return result;
+}
+
+Asteroid *get_asteroid_at(AsteroidArray *asteroids, u32 index)
+{
+  Asteroid *result = get_asteroid_chunk(asteroids, index)->asteroids +
+    (index & ENTITY_CHUNK_MASK);
+  return result;
+}
+
+rect2 *get_asteroid_world_aabb(AsteroidArray *asteroids, u32 index)
+{
+  rect2 *result = get_asteroid_chunk(asteroids, index)->world_aabbs +
+    (index & ENTITY_CHUNK_MASK);
+  return result;
+}
+
+SoaTransform *get_asteroid_soa_transform(AsteroidArray *asteroids, u32 index)
+{
+  SoaTransform *result = get_asteroid_chunk(asteroids, index)->soa_transforms +
+    (index & ENTITY_CHUNK_MASK);
+  return result;
+}
+
+// NOTE(lvl5): call it whenever the transform of the asteroid changes
+void update_asteroid_world_aabb(State *state, u32 index)
+{
+  AsteroidChunk *chunk = get_asteroid_chunk(&state->asteroids, index);
+  u32 offset = index & ENTITY_CHUNK_MASK;
+  Asteroid *asteroid = chunk->asteroids + offset;
+  chunk->world_aabbs[offset] = get_world_aabb(state, asteroid->shape, asteroid->t);
+  chunk->soa_transforms[offset] = get_soa_transform(asteroid->t);
 }
 
-Entity *add_asteroid(State *state, v2 p, f32 scale)
+Asteroid *add_asteroid(State *state, v2 p, f32 scale)
 {
-  state->asteroid_count++;
+  AsteroidArray *asteroids = &state->asteroids;
+  u32 index = asteroids->count++;
+  u32 chunk_index = index >> ENTITY_CHUNK_SHIFT;
+  assert(chunk_index < MAX_ENTITY_CHUNK_COUNT);
+  if (chunk_index == asteroids->chunk_count)
+  {
+    asteroids->chunks[asteroids->chunk_count++] =
+      (AsteroidChunk *)alloc_entity_chunk(state, sizeof(AsteroidChunk));
+  }
+  
+  Asteroid *asteroid = get_asteroid_at(asteroids, index);
+  *asteroid = {};
+  asteroid->handle = add_entity_slot(state, EntityType_ASTEROID, index);
+  asteroid->tree_proxy = AABB_TREE_NULL;
   
   RandomSequence *s = &state->seed;
-  Entity *e = add_entity(state, EntityType_ASTEROID);
   
-  Polygon *poly = &e->shape;
-  *poly = generate_random_convex_polygon(&state->seed, 
-                                         random_range_i32(&state->seed, 4, 16), 1.0f);
+  u32 shape_offset = (u32)random_range_i32(s, 0, ASTEROID_SHAPE_COUNT - 1);
+  asteroid->shape = (ShapeIndex)(state->first_asteroid_shape + shape_offset);
   
-  e->asteroid.scale = scale;
-  e->angular_velocity = random_range(s, -0.9f, 0.9f)/scale;
+  asteroid->scale = scale;
+  asteroid->angular_velocity = random_range(s, -0.9f, 0.9f)/scale;
   
   v2 random_v = v2(random_bilateral(s), random_bilateral(s));
-  e->velocity = random_v*4/scale;
-  e->t.p = p;
-  e->t.scale = v2(scale, scale);
+  asteroid->velocity = random_v*4/scale;
+  assert(len_sqr(asteroid->velocity) <= sqr(ASTEROID_SPEED_LIMIT));
+  asteroid->t.p = p;
+  asteroid->t.angle = 0;
+  asteroid->t.scale = v2(scale, scale);
+  
+  update_asteroid_world_aabb(state, index);
+  return asteroid;
+}
+
+void remove_asteroid(State *state, u32 index)
+{
+  AsteroidArray *asteroids = &state->asteroids;
+  Asteroid *asteroid = get_asteroid_at(asteroids, index);
+  if (asteroid->is_removed)
+  {
+    return;
+  }
+  asteroid->is_removed = true;
+  retire_entity_handle(state, asteroid->handle);
+  
+  if (asteroids->removed_count == 0 || index < asteroids->first_removed_index)
+  {
+    asteroids->first_removed_index = index;
+  }
+  asteroids->removed_count++;
+}
+
+// NOTE(lvl5): one pass that slides the survivors down over the removed
+// asteroids, so everyone keeps their relative order
+void flush_removed_asteroids(State *state)
+{
+  AsteroidArray *asteroids = &state->asteroids;
+  if (asteroids->removed_count == 0)
+  {
+    return;
+  }
+  
+  u32 write_index = asteroids->first_removed_index;
+  for (u32 read_index = asteroids->first_removed_index;
+       read_index < asteroids->count;
+       read_index++)
+  {
+    Asteroid *asteroid = get_asteroid_at(asteroids, read_index);
+    if (asteroid->is_removed)
+    {
+      free_entity_slot(state, asteroid->handle);
+      if (asteroid->tree_proxy != AABB_TREE_NULL)
+      {
+        aabb_tree_remove(&state->tree, asteroid->tree_proxy);
+      }
+      continue;
+    }
+    
+    if (write_index != read_index)
+    {
+      *get_asteroid_at(asteroids, write_index) = *asteroid;
+      *get_asteroid_world_aabb(asteroids, write_index) =
+        *get_asteroid_world_aabb(asteroids, read_index);
+      *get_asteroid_soa_transform(asteroids, write_index) =
+        *get_asteroid_soa_transform(asteroids, read_index);
+      move_entity_slot(state, asteroid->handle, write_index);
+      if (asteroid->tree_proxy != AABB_TREE_NULL)
+      {
+        aabb_tree_set_item(&state->tree, asteroid->tree_proxy, write_index);
+      }
+    }
+    write_index++;
+  }
+  
+  asteroids->count = write_index;
+  asteroids->removed_count = 0;
+}
+
+
+// NOTE(lvl5): bullets
+Transform get_bullet_transform(BulletArray *bullets, u32 index)
+{
+  Transform result;
+  result.p = v2(bullets->p_x[index], bullets->p_y[index]);
+  result.angle = bullets->angle[index];
+  result.scale = v2(0.8f, 0.5f);
+  return result;
+}
+
+// NOTE(lvl5): false when there is no room, the shot is dropped then
+b32 add_bullet(State *state, v2 p, v2 velocity, f32 angle)
+{
+  BulletArray *bullets = &state->bullets;
+  if (bullets->count == MAX_BULLET_COUNT)
+  {
+    return false;
+  }
+  
+  u32 index = bullets->count++;
+  bullets->p_x[index] = p.x;
+  bullets->p_y[index] = p.y;
+  bullets->d_p_x[index] = velocity.x;
+  bullets->d_p_y[index] = velocity.y;
+  bullets->lifetime[index] = 2.0f;
+  bullets->angle[index] = angle;
+  bullets->is_removed[index] = false;
+  bullets->handle[index] = add_entity_slot(state, EntityType_BULLET, index);
+  return true;
+}
+
+void remove_bullet(State *state, u32 index)
+{
+  BulletArray *bullets = &state->bullets;
+  if (bullets->is_removed[index])
+  {
+    return;
+  }
+  bullets->is_removed[index] = true;
+  retire_entity_handle(state, bullets->handle[index]);
   
-  return e;
+  if (bullets->removed_count == 0 || index < bullets->first_removed_index)
+  {
+    bullets->first_removed_index = index;
+  }
+  bullets->removed_count++;
 }
 
-Entity *add_bullet(State *state, v2 p, v2 velocity, f32 angle)
+void flush_removed_bullets(State *state)
 {
-  Entity *e = add_entity(state, EntityType_BULLET);
+  BulletArray *bullets = &state->bullets;
+  if (bullets->removed_count == 0)
+  {
+    return;
+  }
   
-  Polygon *poly = &e->shape;
-  poly->count = 4;
-  poly->vertices[0] = v2(-0.2f, -0.2f);
-  poly->vertices[1] = v2(-0.2f, 0.2f);
-  poly->vertices[2] = v2(0.2f, 0.2f);
-  poly->vertices[3] = v2(0.2f, -0.2f);
+  u32 write_index = bullets->first_removed_index;
+  for (u32 read_index = bullets->first_removed_index;
+       read_index < bullets->count;
+       read_index++)
+  {
+    if (bullets->is_removed[read_index])
+    {
+      free_entity_slot(state, bullets->handle[read_index]);
+      continue;
+    }
+    
+    if (write_index != read_index)
+    {
+      bullets->p_x[write_index] = bullets->p_x[read_index];
+      bullets->p_y[write_index] = bullets->p_y[read_index];
+      bullets->d_p_x[write_index] = bullets->d_p_x[read_index];
+      bullets->d_p_y[write_index] = bullets->d_p_y[read_index];
+      bullets->lifetime[write_index] = bullets->lifetime[read_index];
+      bullets->angle[write_index] = bullets->angle[read_index];
+      bullets->handle[write_index] = bullets->handle[read_index];
+      bullets->is_removed[write_index] = false;
+      move_entity_slot(state, bullets->handle[write_index], write_index);
+    }
+    write_index++;
+  }
   
-  e->t.p = p;
-  e->t.angle = angle;
-  e->t.scale = v2(0.8f, 0.5f);
-  e->velocity = velocity;
-  e->bullet.lifetime = 2.0f;
-  return e;
+  bullets->count = write_index;
+  bullets->removed_count = 0;
 }
 
-Entity *add_temporary_clone(State *state, Entity *e, v2 p)
+// NOTE(lvl5): moves, wraps and ages 8 bullets at a time
+void move_bullets(BulletArray *bullets, f32 dt, v2 area)
 {
-  Entity *clone = add_entity(state, e->type);
-  *clone = *e;
-  clone->is_temporary = true;
-  clone->t.p = p;
+  f32x8 wide_dt = f32x8(dt);
+  v2x8 wide_area = v2x8(area);
+  v2x8 half_area = v2x8(area*0.5f);
+  v2x8 neg_half_area = v2x8(-area*0.5f);
+  f32x8 zero = f32x8(0.0f);
   
-  return clone;
+  for (u32 bullet_index = 0;
+       bullet_index < bullets->count;
+       bullet_index += 8)
+  {
+    v2x8 p = load_v2x8(bullets->p_x + bullet_index, bullets->p_y + bullet_index);
+    v2x8 d_p = load_v2x8(bullets->d_p_x + bullet_index, bullets->d_p_y + bullet_index);
+    f32x8 lifetime = load_f32x8(bullets->lifetime + bullet_index);
+    
+    p += d_p*wide_dt;
+    
+    p.x = p.x - select(p.x > half_area.x, wide_area.x, zero);
+    p.x = p.x + select(p.x < neg_half_area.x, wide_area.x, zero);
+    p.y = p.y - select(p.y > half_area.y, wide_area.y, zero);
+    p.y = p.y + select(p.y < neg_half_area.y, wide_area.y, zero);
+    
+    lifetime = lifetime - wide_dt;
+    
+    store(bullets->p_x + bullet_index, bullets->p_y + bullet_index, p);
+    store(bullets->lifetime + bullet_index, lifetime);
+  }
 }
 
 // NOTE(lvl5): collision stuff
-RangeF32 project_polygon_vertices_on_normal(Polygon poly, v2 normal)
+RangeF32 project_polygon_vertices_on_normal(Polygon *poly, v2 normal)
 {
   RangeF32 result = inverted_range_f32();
   
   for (u32 vertex_index = 0;
-       vertex_index < poly.count;
+       vertex_index < poly->count;
        vertex_index++)
   {
-    v2 vertex = poly.vertices[vertex_index];
+    v2 vertex = poly->vertices[vertex_index];
     f32 proj = dot(vertex, normal);
     if (proj < result.min)
     {
@@ -337,7 +712,7 @@ RangeF32 project_polygon_vertices_on_normal(Polygon poly, v2 normal)
   return result;
 }
 
-b32 intersection_along_normal(Polygon a, Polygon b, v2 normal)
+b32 intersection_along_normal(Polygon *a, Polygon *b, v2 normal)
 {
   // NOTE(lvl5): calculate projections of every vertex of both shapes on the
   // normal and find min and max of both shapes
@@ -355,15 +730,15 @@ b32 intersection_along_normal(Polygon a, Polygon b, v2 normal)
   return true;
 }
 
-b32 test_polygon_normals(Polygon a, Polygon b)
+b32 test_polygon_normals(Polygon *a, Polygon *b)
 {
   for (u32 start_vertex_index = 0;
-       start_vertex_index < a.count;
+       start_vertex_index < a->count;
        start_vertex_index++)
   {
-    u32 end_vertex_index = start_vertex_index == a.count - 1 ? 0 : start_vertex_index + 1;
-    v2 start = a.vertices[start_vertex_index];
-    v2 end = a.vertices[end_vertex_index];
+    u32 end_vertex_index = start_vertex_index == a->count - 1 ? 0 : start_vertex_index + 1;
+    v2 start = a->vertices[start_vertex_index];
+    v2 end = a->vertices[end_vertex_index];
     
     // NOTE(lvl5): check normal of every surface
     v2 surface = end - start;
@@ -379,7 +754,7 @@ b32 test_polygon_normals(Polygon a, Polygon b)
   return true;
 }
 
-b32 polygons_intersect(Polygon a, Polygon b)
+b32 polygons_intersect(Polygon *a, Polygon *b)
 {
   
   if (!test_polygon_normals(a, b) ||
@@ -391,118 +766,1353 @@ b32 polygons_intersect(Polygon a, Polygon b)
   return true;
 }
 
+// NOTE(lvl5): SSE version of the separating axis test. Vertices are stored
+// as separate x and y arrays, padded to a multiple of 4 by repeating the
+// first vertex, so 4 vertices get projected on a normal per instruction.
+// The edge normals are worked out once when the polygon is converted.
+// polygons_intersect above is the reference it has to agree with.
+struct PolygonSoa
+{
+  alignas(16) f32 x[16];
+  alignas(16) f32 y[16];
+  f32 normal_x[16];
+  f32 normal_y[16];
+  u32 count;
+  u32 lane_group_count;
+};
 
-Entity *check_collision(State *state, Entity *e, EntityType type)
+void pad_soa_vertices(PolygonSoa *result)
 {
-  Entity *result = 0;
-  
-  for (u32 entitiy_index = 1;
-       entitiy_index < state->entities_count;
-       entitiy_index++)
+  result->lane_group_count = (result->count + 3)/4;
+  u32 padded_count = result->lane_group_count*4;
+  for (u32 vertex_index = result->count;
+       vertex_index < padded_count;
+       vertex_index++)
   {
-    Entity *other = get_entity(state, entitiy_index);
-    if (other == e)
-    {
-      continue;
-    }
-    if (other->type != type)
-    {
-      continue;
-    }
-    
-    b32 did_collide = polygons_intersect(transform_polygon(e->shape, e->t), transform_polygon(other->shape, other->t));
-    if (did_collide)
-    {
-      result = other;
-      break;
-    }
+    result->x[vertex_index] = result->x[0];
+    result->y[vertex_index] = result->y[0];
   }
-  return result;
 }
 
-void add_particles(ParticleSystem *s, u32 count, rect2 area, v2 min_direction, v2 max_direction)
+void polygon_to_soa(Polygon *poly, PolygonSoa *result)
 {
-  for (u32 particle_index = 0;
-       particle_index < count;
-       particle_index++)
+  assert(poly->count > 0 && poly->count <= array_count(result->x));
+  result->count = poly->count;
+  
+  for (u32 vertex_index = 0;
+       vertex_index < poly->count;
+       vertex_index++)
   {
-    if (s->items_count == s->items_capacity)
-    {
-      break;
-    }
-    Particle *part = s->items + s->items_count++;
-    part->t.p = v2(random_range(&s->seed, area.min.x, area.max.x),
-                   random_range(&s->seed, area.min.y, area.max.y));
-    part->t.scale = v2(1, 1)*random_range(&s->seed, 0.2f, 0.3f);
-    
-    v2 direction = normalize(v2(random_range(&s->seed, min_direction.x, max_direction.x),
-                                random_range(&s->seed, min_direction.y, max_direction.y)));
-    part->d_p = direction*random_range(&s->seed, 0.5f, 5.0f);
-    part->d_scale = v2(1, 1)*random_range(&s->seed, -0.2f, -2.5f);
+    u32 next_vertex_index = vertex_index == poly->count - 1 ? 0 : vertex_index + 1;
+    v2 v = poly->vertices[vertex_index];
+    v2 normal = perp(poly->vertices[next_vertex_index] - v);
+    result->x[vertex_index] = v.x;
+    result->y[vertex_index] = v.y;
+    result->normal_x[vertex_index] = normal.x;
+    result->normal_y[vertex_index] = normal.y;
   }
+  pad_soa_vertices(result);
 }
 
+// NOTE(lvl5): the padding of the shape goes through too, so it comes out
+// already padded
+void shape_to_soa(Shape *shape, SoaTransform *transform, PolygonSoa *result)
+{
+  result->count = shape->count;
+  result->lane_group_count = shape->padded_count/4;
+  
+  transform_vertices(transform->m, shape->vertex_x, shape->vertex_y,
+                     result->x, result->y, shape->padded_count);
+  transform_vertices(transform->normal_m, shape->normal_x, shape->normal_y,
+                     result->normal_x, result->normal_y, shape->padded_count);
+}
 
-void simulate_and_draw_particles(ParticleSystem *s, RenderGroup *group, f32 dt)
+// NOTE(lvl5): moving a polygon doesn't change its normals. A shape made at
+// the origin and moved here comes out the same as one made at p
+void translate_soa(PolygonSoa *soa, v2 p)
 {
-  for (u32 particle_index = 0;
-       particle_index < s->items_count;
-       particle_index++)
+  v2x4 wide_p = v2x4(p);
+  for (u32 group_index = 0;
+       group_index < soa->lane_group_count;
+       group_index++)
   {
-    Particle *part = s->items + particle_index;
-    part->t.p += part->d_p*dt;
-    part->t.scale += part->d_scale*dt;
-    
-    rect2 rect = rect_center_size(v2(), v2(1, 1));
-    
-    if (part->t.scale.x <= 0)
-    {
-      Particle *last = s->items + s->items_count - 1;
-      *part = *last;
-      s->items_count--;
-    }
-    else
-    {
-      push_rect(group, rect, part->t, COLOR_RED);
-    }
+    f32 *x = soa->x + group_index*4;
+    f32 *y = soa->y + group_index*4;
+    store_aligned(x, y, load_aligned_v2x4(x, y) + wide_p);
   }
 }
 
-void generate_asteroids(State *state)
+// NOTE(lvl5): the shape at t without the translation, for tests that move
+// one shape around with translate_soa
+void shape_to_origin_soa(Shape *shape, Transform t, PolygonSoa *result)
 {
-  for (u32 asteroid_index = 0;
-       asteroid_index < state->asteroids_per_wave;
-       asteroid_index++)
-  {
-    v2 random_p = v2(-0.5f, 0.5f);//v2(random_bilateral(&state->seed),
-    //random_bilateral(&state->seed));
-    v2 p = hadamard(random_p, state->game_area_size);
-    add_asteroid(state, p, 2.5f);
-  }
-  
-  state->asteroids_per_wave += 2;
+  t.p = v2();
+  SoaTransform transform = get_soa_transform(t);
+  shape_to_soa(shape, &transform, result);
 }
 
-void draw_entity(RenderGroup *render_group, Entity *e)
+void project_soa_vertices_on_normal(PolygonSoa *poly, v2x4 normal,
+                                    f32x4 *proj_min, f32x4 *proj_max)
 {
-  switch (e->type)
+  f32x4 result_min = f32x4(F32_MAX);
+  f32x4 result_max = f32x4(F32_MIN);
+  
+  for (u32 group_index = 0;
+       group_index < poly->lane_group_count;
+       group_index++)
   {
-    case EntityType_ASTEROID:
-    case EntityType_PLAYER:
-    {
-      v4 color = COLOR_WHITE;
-      
-      Transform t = e->t;
-      t.scale = v2(1, 1);
-      push_polygon(render_group, e->shape, e->t, color);
-    } break;
-    case EntityType_BULLET:
-    {
-      push_rect(render_group, polygon_to_rect2(e->shape), e->t, COLOR_WHITE);
-    } break;
+    v2x4 v = load_aligned_v2x4(poly->x + group_index*4, poly->y + group_index*4);
+    f32x4 proj = dot(v, normal);
+    result_min = min(result_min, proj);
+    result_max = max(result_max, proj);
   }
+  
+  *proj_min = result_min;
+  *proj_max = result_max;
 }
 
+b32 soa_projections_overlap(f32x4 a_min, f32x4 a_max, f32x4 b_min, f32x4 b_max)
+{
+  // NOTE(lvl5): reduce the lanes of all four at once, the lanes of ranges
+  // are (a_min, b_min, -a_max, -b_max)
+  f32x4 ranges = reduce_min(a_min, b_min, -a_max, -b_max);
+  
+  alignas(16) f32 range_values[4];
+  store_aligned(range_values, ranges);
+  f32 range_a_min = range_values[0];
+  f32 range_b_min = range_values[1];
+  f32 range_a_max = -range_values[2];
+  f32 range_b_max = -range_values[3];
+  
+  b32 intersection_not_found = range_b_min > range_a_max ||
+    range_a_min > range_b_max;
+  return !intersection_not_found;
+}
+
+b32 soa_polygons_overlap_on_axis(PolygonSoa *a, PolygonSoa *b, v2 axis)
+{
+  v2x4 wide_axis = v2x4(axis);
+  
+  f32x4 a_min, a_max, b_min, b_max;
+  project_soa_vertices_on_normal(a, wide_axis, &a_min, &a_max);
+  project_soa_vertices_on_normal(b, wide_axis, &b_min, &b_max);
+  
+  b32 result = soa_projections_overlap(a_min, a_max, b_min, b_max);
+  return result;
+}
+
+// NOTE(lvl5): index of the first normal of a that separates the two, or
+// a->count when none does
+u32 find_separating_normal_soa(PolygonSoa *a, PolygonSoa *b)
+{
+  for (u32 normal_index = 0;
+       normal_index < a->count;
+       normal_index++)
+  {
+    v2x4 wide_normal = v2x4(v2(a->normal_x[normal_index], a->normal_y[normal_index]));
+    
+    f32x4 a_min, a_max, b_min, b_max;
+    project_soa_vertices_on_normal(a, wide_normal, &a_min, &a_max);
+    project_soa_vertices_on_normal(b, wide_normal, &b_min, &b_max);
+    
+    if (!soa_projections_overlap(a_min, a_max, b_min, b_max))
+    {
+      return normal_index;
+    }
+  }
+  
+  return a->count;
+}
+
+// NOTE(lvl5): the normals of a come first, then the ones of b. The index
+// of the separating axis is also how many axes were tried before it
+#define SAT_NO_SEPARATING_AXIS U32_MAX
+
+u32 find_separating_axis_soa(PolygonSoa *a, PolygonSoa *b)
+{
+  u32 result = find_separating_normal_soa(a, b);
+  if (result == a->count)
+  {
+    u32 b_normal_index = find_separating_normal_soa(b, a);
+    result = b_normal_index == b->count
+      ? SAT_NO_SEPARATING_AXIS
+      : a->count + b_normal_index;
+  }
+  return result;
+}
+
+u32 get_sat_axes_tested(PolygonSoa *a, PolygonSoa *b, u32 axis_index)
+{
+  u32 result = axis_index == SAT_NO_SEPARATING_AXIS
+    ? a->count + b->count
+    : axis_index + 1;
+  return result;
+}
+
+v2 get_separating_axis(PolygonSoa *a, PolygonSoa *b, u32 axis_index)
+{
+  assert(axis_index != SAT_NO_SEPARATING_AXIS);
+  v2 result = axis_index < a->count
+    ? v2(a->normal_x[axis_index], a->normal_y[axis_index])
+    : v2(b->normal_x[axis_index - a->count], b->normal_y[axis_index - a->count]);
+  return result;
+}
+
+b32 polygons_intersect_soa(PolygonSoa *a, PolygonSoa *b)
+{
+  b32 result = find_separating_axis_soa(a, b) == SAT_NO_SEPARATING_AXIS;
+  return result;
+}
+
+// NOTE(lvl5): the same test with both vertex counts known at compile time,
+// so every loop has a constant trip count and gets unrolled. Bullets are
+// boxes and the ship is a triangle, so pairs with a 3 or a 4 on either side
+// are most of what the game tests. Everything else goes to the generic one,
+// see find_separating_axis_soa_dispatch
+template <u32 count>
+void project_fixed_soa_vertices_on_normal(PolygonSoa *poly, v2x4 normal,
+                                          f32x4 *proj_min, f32x4 *proj_max)
+{
+  const u32 lane_group_count = (count + 3)/4;
+  f32x4 result_min = f32x4(F32_MAX);
+  f32x4 result_max = f32x4(F32_MIN);
+  
+  for (u32 group_index = 0;
+       group_index < lane_group_count;
+       group_index++)
+  {
+    v2x4 v = load_aligned_v2x4(poly->x + group_index*4, poly->y + group_index*4);
+    f32x4 proj = dot(v, normal);
+    result_min = min(result_min, proj);
+    result_max = max(result_max, proj);
+  }
+  
+  *proj_min = result_min;
+  *proj_max = result_max;
+}
+
+template <u32 a_count, u32 b_count>
+u32 find_fixed_separating_normal_soa(PolygonSoa *a, PolygonSoa *b)
+{
+  for (u32 normal_index = 0;
+       normal_index < a_count;
+       normal_index++)
+  {
+    v2x4 wide_normal = v2x4(v2(a->normal_x[normal_index], a->normal_y[normal_index]));
+    
+    f32x4 a_min, a_max, b_min, b_max;
+    project_fixed_soa_vertices_on_normal<a_count>(a, wide_normal, &a_min, &a_max);
+    project_fixed_soa_vertices_on_normal<b_count>(b, wide_normal, &b_min, &b_max);
+    
+    if (!soa_projections_overlap(a_min, a_max, b_min, b_max))
+    {
+      return normal_index;
+    }
+  }
+  
+  return a_count;
+}
+
+template <u32 a_count, u32 b_count>
+u32 find_fixed_separating_axis_soa(PolygonSoa *a, PolygonSoa *b)
+{
+  assert(a->count == a_count && b->count == b_count);
+  u32 result = find_fixed_separating_normal_soa<a_count, b_count>(a, b);
+  if (result == a_count)
+  {
+    u32 b_normal_index = find_fixed_separating_normal_soa<b_count, a_count>(b, a);
+    result = b_normal_index == b_count
+      ? SAT_NO_SEPARATING_AXIS
+      : a_count + b_normal_index;
+  }
+  return result;
+}
+
+typedef u32 FindSeparatingAxisSoa(PolygonSoa *a, PolygonSoa *b);
+
+#define SAT_FIXED(a, b) find_fixed_separating_axis_soa<a, b>
+#define SAT_GENERIC find_separating_axis_soa
+#define SAT_TABLE_ROW_ALL(a) { \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_FIXED(a, 3), SAT_FIXED(a, 4), \
+  SAT_FIXED(a, 5), SAT_FIXED(a, 6), SAT_FIXED(a, 7), SAT_FIXED(a, 8), \
+  SAT_FIXED(a, 9), SAT_FIXED(a, 10), SAT_FIXED(a, 11), SAT_FIXED(a, 12), \
+  SAT_FIXED(a, 13), SAT_FIXED(a, 14), SAT_FIXED(a, 15), SAT_FIXED(a, 16), \
+}
+#define SAT_TABLE_ROW_SMALL(a) { \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_FIXED(a, 3), SAT_FIXED(a, 4), \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+}
+#define SAT_TABLE_ROW_GENERIC { \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+  SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, SAT_GENERIC, \
+}
+
+// NOTE(lvl5): indexed by the vertex counts of a and b
+FindSeparatingAxisSoa *sat_dispatch_table[17][17] = {
+  SAT_TABLE_ROW_GENERIC,
+  SAT_TABLE_ROW_GENERIC,
+  SAT_TABLE_ROW_GENERIC,
+  SAT_TABLE_ROW_ALL(3),
+  SAT_TABLE_ROW_ALL(4),
+  SAT_TABLE_ROW_SMALL(5),
+  SAT_TABLE_ROW_SMALL(6),
+  SAT_TABLE_ROW_SMALL(7),
+  SAT_TABLE_ROW_SMALL(8),
+  SAT_TABLE_ROW_SMALL(9),
+  SAT_TABLE_ROW_SMALL(10),
+  SAT_TABLE_ROW_SMALL(11),
+  SAT_TABLE_ROW_SMALL(12),
+  SAT_TABLE_ROW_SMALL(13),
+  SAT_TABLE_ROW_SMALL(14),
+  SAT_TABLE_ROW_SMALL(15),
+  SAT_TABLE_ROW_SMALL(16),
+};
+
+#undef SAT_TABLE_ROW_GENERIC
+#undef SAT_TABLE_ROW_SMALL
+#undef SAT_TABLE_ROW_ALL
+#undef SAT_GENERIC
+#undef SAT_FIXED
+
+u32 find_separating_axis_soa_dispatch(PolygonSoa *a, PolygonSoa *b)
+{
+  assert(a->count < array_count(sat_dispatch_table) &&
+         b->count < array_count(sat_dispatch_table[0]));
+  u32 result = sat_dispatch_table[a->count][b->count](a, b);
+  return result;
+}
+
+b32 polygons_intersect_soa_dispatch(PolygonSoa *a, PolygonSoa *b)
+{
+  b32 result = find_separating_axis_soa_dispatch(a, b) == SAT_NO_SEPARATING_AXIS;
+  return result;
+}
+
+
+b32 circles_overlap(v2 a_center, f32 a_radius, v2 b_center, f32 b_radius)
+{
+  f32 radius = a_radius + b_radius;
+  b32 result = len_sqr(a_center - b_center) <= radius*radius;
+  return result;
+}
+
+// NOTE(lvl5): a moving past b. Like circles_overlap, but for every point
+// the center of a passes on the way from a_start to a_start + d_p
+b32 swept_circles_overlap(v2 a_start, v2 d_p, f32 a_radius, v2 b_center, f32 b_radius)
+{
+  f32 d_p_len_sqr = len_sqr(d_p);
+  f32 t = 0;
+  if (d_p_len_sqr > 0)
+  {
+    t = dot(b_center - a_start, d_p)/d_p_len_sqr;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+  }
+  b32 result = circles_overlap(a_start + d_p*t, a_radius, b_center, b_radius);
+  return result;
+}
+
+RangeF32 reduce_soa_projection(f32x4 min, f32x4 max)
+{
+  RangeF32 result = range_f32(reduce_min(min), reduce_max(max));
+  return result;
+}
+
+// NOTE(lvl5): a moves by d_p over the frame while b holds still, so pass
+// the motion of a relative to b. Writes the part of [0, 1] in which the
+// projections on axis overlap, false when they don't overlap in the frame
+b32 sweep_soa_on_axis(PolygonSoa *a, v2 d_p, PolygonSoa *b, v2 axis,
+                      f32 *t_enter, f32 *t_exit)
+{
+  v2x4 wide_axis = v2x4(axis);
+  
+  f32x4 a_min, a_max, b_min, b_max;
+  project_soa_vertices_on_normal(a, wide_axis, &a_min, &a_max);
+  project_soa_vertices_on_normal(b, wide_axis, &b_min, &b_max);
+  RangeF32 range_a = reduce_soa_projection(a_min, a_max);
+  RangeF32 range_b = reduce_soa_projection(b_min, b_max);
+  
+  f32 enter = 0;
+  f32 exit = 1;
+  f32 speed = dot(d_p, axis);
+  if (speed == 0)
+  {
+    if (range_b.min > range_a.max || range_a.min > range_b.max)
+    {
+      enter = 1;
+      exit = 0;
+    }
+  }
+  else
+  {
+    // NOTE(lvl5): when the leading side of a reaches b, and when the
+    // trailing side leaves it
+    f32 touch_t = (range_b.min - range_a.max)/speed;
+    f32 leave_t = (range_b.max - range_a.min)/speed;
+    if (touch_t > leave_t)
+    {
+      swap(touch_t, leave_t);
+    }
+    if (touch_t > enter) enter = touch_t;
+    if (leave_t < exit) exit = leave_t;
+  }
+  
+  *t_enter = enter;
+  *t_exit = exit;
+  b32 result = enter <= exit;
+  return result;
+}
+
+struct SweepResult
+{
+  b32 hit;
+  // NOTE(lvl5): first time of contact in [0, 1] on a hit
+  f32 t;
+  // NOTE(lvl5): the axis the test stopped on, numbered like in
+  // find_separating_axis_soa. On a miss it kept the two apart for the whole
+  // frame on its own when is_single_axis is set, otherwise it only closed
+  // the window left by the axes before it
+  u32 axis_index;
+  b32 is_single_axis;
+};
+
+// NOTE(lvl5): separating axis test of a moving against b, exact as long as
+// neither rotates. Every axis bounds when the two can touch, they touch
+// where all the bounds agree, so the same axes as the static test do
+SweepResult sweep_soa(PolygonSoa *a, v2 d_p, PolygonSoa *b)
+{
+  SweepResult result = {};
+  f32 first_t = 0;
+  f32 last_t = 1;
+  u32 axis_count = a->count + b->count;
+  for (u32 axis_index = 0;
+       axis_index < axis_count;
+       axis_index++)
+  {
+    v2 axis = get_separating_axis(a, b, axis_index);
+    f32 t_enter, t_exit;
+    if (!sweep_soa_on_axis(a, d_p, b, axis, &t_enter, &t_exit))
+    {
+      result.axis_index = axis_index;
+      result.is_single_axis = true;
+      return result;
+    }
+    
+    if (t_enter > first_t) first_t = t_enter;
+    if (t_exit < last_t) last_t = t_exit;
+    if (first_t > last_t)
+    {
+      result.axis_index = axis_index;
+      return result;
+    }
+  }
+  
+  result.hit = true;
+  result.t = first_t;
+  result.axis_index = SAT_NO_SEPARATING_AXIS;
+  return result;
+}
+
+u64 get_sat_cache_key(EntityHandle a, EntityHandle b)
+{
+  u64 result = ((u64)a << 32) | b;
+  return result;
+}
+
+u32 get_sat_cache_home_index(u64 key)
+{
+  u32 result = (u32)((key*0x9E3779B97F4A7C15ULL) >> 32) & (SAT_CACHE_SIZE - 1);
+  return result;
+}
+
+b32 is_sat_cache_entry_live(SatCache *cache, SatCacheEntry *entry)
+{
+  b32 result = entry->frame_index + 1 >= cache->frame_index;
+  return result;
+}
+
+// NOTE(lvl5): 0 when the pair wasn't separated last frame or this one
+SatCacheEntry *find_sat_cache_entry(SatCache *cache, u64 key)
+{
+  u32 home_index = get_sat_cache_home_index(key);
+  for (u32 probe_index = 0;
+       probe_index < SAT_CACHE_PROBE_COUNT;
+       probe_index++)
+  {
+    SatCacheEntry *entry = cache->entries +
+      ((home_index + probe_index) & (SAT_CACHE_SIZE - 1));
+    if (entry->key == key && is_sat_cache_entry_live(cache, entry))
+    {
+      return entry;
+    }
+  }
+  return 0;
+}
+
+// NOTE(lvl5): when every probed entry is live the home one loses, the cache
+// only ever costs a wasted projection
+void store_sat_cache_axis(SatCache *cache, u64 key, v2 axis)
+{
+  u32 home_index = get_sat_cache_home_index(key);
+  SatCacheEntry *result = cache->entries + home_index;
+  for (u32 probe_index = 0;
+       probe_index < SAT_CACHE_PROBE_COUNT;
+       probe_index++)
+  {
+    SatCacheEntry *entry = cache->entries +
+      ((home_index + probe_index) & (SAT_CACHE_SIZE - 1));
+    if (entry->key == key || !is_sat_cache_entry_live(cache, entry))
+    {
+      result = entry;
+      break;
+    }
+  }
+  
+  result->key = key;
+  result->axis = axis;
+  result->frame_index = cache->frame_index;
+}
+
+// NOTE(lvl5): every shape that looks for asteroids gets MAX_WRAP_OFFSET_COUNT
+// query ids in a row, one per wrap offset
+#define PLAYER_QUERY_ID 0
+
+u32 get_query_id(u32 bullet_index)
+{
+  u32 result = (bullet_index + 1)*MAX_WRAP_OFFSET_COUNT;
+  return result;
+}
+
+// NOTE(lvl5): asteroids that can touch the shape of query_id, already moved
+// by its wrap offset, see find_query_pairs
+u32 get_asteroid_candidates(State *state, u32 query_id, u32 **candidates)
+{
+  assert(query_id < state->query_id_count);
+  u32 first = state->query_pair_first[query_id];
+  *candidates = state->query_pair_items + first;
+  u32 result = state->query_pair_first[query_id + 1] - first;
+  return result;
+}
+
+// NOTE(lvl5): where a shape that moved by d_p this frame could have touched
+// an asteroid, which might have moved up to ASTEROID_SPEED_LIMIT*dt
+rect2 get_swept_query_aabb(Shape *shape, Transform t, v2 d_p, f32 dt)
+{
+  rect2 result = get_shape_aabb(shape, t);
+  if (d_p.x > 0) result.min.x -= d_p.x; else result.max.x -= d_p.x;
+  if (d_p.y > 0) result.min.y -= d_p.y; else result.max.y -= d_p.y;
+  f32 asteroid_reach = 2*ASTEROID_SPEED_LIMIT*dt;
+  result = resize_centered(result, v2(asteroid_reach, asteroid_reach));
+  return result;
+}
+
+rect2 get_collision_query_aabb(State *state, CollisionQuery *query, f32 dt)
+{
+  Shape *shape = get_shape(&state->shapes, query->shape);
+  rect2 result = query->is_swept
+    ? get_swept_query_aabb(shape, query->t, query->d_p, dt)
+    : get_shape_aabb(shape, query->t);
+  return result;
+}
+
+// NOTE(lvl5): every candidate adds at most one
+void add_sat_cache_update(CollisionQuery *query, u64 key, v2 axis)
+{
+  assert(query->cache_update_count < query->cache_update_capacity);
+  SatCacheUpdate *update = query->cache_updates + query->cache_update_count++;
+  update->key = key;
+  update->axis = axis;
+}
+
+// NOTE(lvl5): the first asteroid that overlaps the shape. Near the edge of
+// the world the shape is also tested shifted to the other side, instead of
+// keeping copies of the asteroids there. Bounding circles go first, the
+// polygons are only transformed for pairs that get past them
+#define ASTEROID_NONE U32_MAX
+
+void find_colliding_asteroid(State *state, CollisionQuery *query)
+{
+  assert(broadphase_is_ready(state));
+  query->asteroid_index = ASTEROID_NONE;
+  query->hit_t = 0;
+  AsteroidArray *asteroids = &state->asteroids;
+  SatCache *cache = &state->sat_cache;
+  
+  Transform t = query->t;
+  Shape *shape = get_shape(&state->shapes, query->shape);
+  f32 radius = get_world_radius(shape, t);
+  rect2 aabb = get_shape_aabb(shape, t);
+  
+  // NOTE(lvl5): made once for the query, then moved to each offset
+  b32 has_origin_soa = false;
+  PolygonSoa origin_soa;
+  
+  v2 offsets[MAX_WRAP_OFFSET_COUNT];
+  u32 offset_count = get_wrap_offsets(aabb, state->query_wrap_bounds,
+                                      state->game_area_size, offsets);
+  for (u32 offset_index = 0;
+       offset_index < offset_count && query->asteroid_index == ASTEROID_NONE;
+       offset_index++)
+  {
+    Transform query_t = translate(t, offsets[offset_index]);
+    
+    u32 *candidates;
+    u32 candidate_count = get_asteroid_candidates(state, query->query_id + offset_index,
+                                                  &candidates);
+    b32 has_soa = false;
+    PolygonSoa soa;
+    
+    for (u32 candidate_index = 0;
+         candidate_index < candidate_count;
+         candidate_index++)
+    {
+      u32 asteroid_index = candidates[candidate_index];
+      Asteroid *asteroid = get_asteroid_at(asteroids, asteroid_index);
+      if (asteroid->is_removed)
+      {
+        continue;
+      }
+      
+      Shape *other_shape = get_shape(&state->shapes, asteroid->shape);
+      f32 other_radius = get_world_radius(other_shape, asteroid->t);
+      if (!circles_overlap(query_t.p, radius, asteroid->t.p, other_radius))
+      {
+        continue;
+      }
+      
+      if (!has_origin_soa)
+      {
+        shape_to_origin_soa(shape, t, &origin_soa);
+        has_origin_soa = true;
+      }
+      if (!has_soa)
+      {
+        soa = origin_soa;
+        translate_soa(&soa, query_t.p);
+        has_soa = true;
+      }
+      PolygonSoa other_soa;
+      shape_to_soa(other_shape, get_asteroid_soa_transform(asteroids, asteroid_index),
+                   &other_soa);
+      query->frame_counters[FrameCounter_SAT_PAIRS]++;
+      
+      u64 key = get_sat_cache_key(query->handle, asteroid->handle);
+      SatCacheEntry *entry = find_sat_cache_entry(cache, key);
+      if (entry)
+      {
+        query->frame_counters[FrameCounter_SAT_CACHE_LOOKUPS]++;
+        query->frame_counters[FrameCounter_SAT_AXES]++;
+        if (!soa_polygons_overlap_on_axis(&soa, &other_soa, entry->axis))
+        {
+          query->frame_counters[FrameCounter_SAT_CACHE_HITS]++;
+          add_sat_cache_update(query, key, entry->axis);
+          continue;
+        }
+      }
+      
+      u32 axis_index = find_separating_axis_soa_dispatch(&soa, &other_soa);
+      query->frame_counters[FrameCounter_SAT_AXES] +=
+        get_sat_axes_tested(&soa, &other_soa, axis_index);
+      if (axis_index == SAT_NO_SEPARATING_AXIS)
+      {
+        query->asteroid_index = asteroid_index;
+        break;
+      }
+      add_sat_cache_update(query, key, get_separating_axis(&soa, &other_soa, axis_index));
+    }
+  }
+}
+
+// NOTE(lvl5): like find_colliding_asteroid, but for a shape that moved by
+// d_p this frame to end up at t, so fast things can't skip over asteroids
+// when dt is large. Asteroids are swept along their velocity too, at the
+// angle they ended the frame at. Finds the asteroid that was touched first
+// and when, as a fraction of the frame
+void find_first_swept_asteroid(State *state, CollisionQuery *query, f32 dt)
+{
+  assert(broadphase_is_ready(state));
+  query->asteroid_index = ASTEROID_NONE;
+  query->hit_t = 1;
+  AsteroidArray *asteroids = &state->asteroids;
+  SatCache *cache = &state->sat_cache;
+  
+  Transform t = query->t;
+  v2 d_p = query->d_p;
+  Shape *shape = get_shape(&state->shapes, query->shape);
+  f32 radius = get_world_radius(shape, t);
+  rect2 aabb = get_swept_query_aabb(shape, t, d_p, dt);
+  
+  // NOTE(lvl5): made once for the query, then moved to where it starts
+  // relative to each asteroid
+  b32 has_origin_soa = false;
+  PolygonSoa origin_soa;
+  
+  v2 offsets[MAX_WRAP_OFFSET_COUNT];
+  u32 offset_count = get_wrap_offsets(aabb, state->query_wrap_bounds,
+                                      state->game_area_size, offsets);
+  for (u32 offset_index = 0;
+       offset_index < offset_count;
+       offset_index++)
+  {
+    Transform query_t = translate(t, offsets[offset_index]);
+    
+    u32 *candidates;
+    u32 candidate_count = get_asteroid_candidates(state, query->query_id + offset_index,
+                                                  &candidates);
+    for (u32 candidate_index = 0;
+         candidate_index < candidate_count;
+         candidate_index++)
+    {
+      u32 asteroid_index = candidates[candidate_index];
+      Asteroid *asteroid = get_asteroid_at(asteroids, asteroid_index);
+      if (asteroid->is_removed)
+      {
+        continue;
+      }
+      
+      v2 relative_d_p = d_p - asteroid->velocity*dt;
+      Transform start_t = translate(query_t, -relative_d_p);
+      Shape *other_shape = get_shape(&state->shapes, asteroid->shape);
+      f32 other_radius = get_world_radius(other_shape, asteroid->t);
+      if (!swept_circles_overlap(start_t.p, relative_d_p, radius,
+                                 asteroid->t.p, other_radius))
+      {
+        continue;
+      }
+      
+      if (!has_origin_soa)
+      {
+        shape_to_origin_soa(shape, t, &origin_soa);
+        has_origin_soa = true;
+      }
+      PolygonSoa soa = origin_soa;
+      translate_soa(&soa, start_t.p);
+      PolygonSoa other_soa;
+      shape_to_soa(other_shape, get_asteroid_soa_transform(asteroids, asteroid_index),
+                   &other_soa);
+      query->frame_counters[FrameCounter_SAT_PAIRS]++;
+      
+      u64 key = get_sat_cache_key(query->handle, asteroid->handle);
+      SatCacheEntry *entry = find_sat_cache_entry(cache, key);
+      if (entry)
+      {
+        query->frame_counters[FrameCounter_SAT_CACHE_LOOKUPS]++;
+        query->frame_counters[FrameCounter_SAT_AXES]++;
+        f32 t_enter, t_exit;
+        if (!sweep_soa_on_axis(&soa, relative_d_p, &other_soa, entry->axis,
+                               &t_enter, &t_exit))
+        {
+          query->frame_counters[FrameCounter_SAT_CACHE_HITS]++;
+          add_sat_cache_update(query, key, entry->axis);
+          continue;
+        }
+      }
+      
+      SweepResult sweep = sweep_soa(&soa, relative_d_p, &other_soa);
+      query->frame_counters[FrameCounter_SAT_AXES] +=
+        get_sat_axes_tested(&soa, &other_soa, sweep.axis_index);
+      if (sweep.hit)
+      {
+        // NOTE(lvl5): ties go to the lower index, so the order the
+        // broadphase hands out candidates in doesn't matter
+        if (query->asteroid_index == ASTEROID_NONE || sweep.t < query->hit_t ||
+            (sweep.t == query->hit_t && asteroid_index < query->asteroid_index))
+        {
+          query->asteroid_index = asteroid_index;
+          query->hit_t = sweep.t;
+        }
+      }
+      else if (sweep.is_single_axis)
+      {
+        add_sat_cache_update(query, key,
+                             get_separating_axis(&soa, &other_soa, sweep.axis_index));
+      }
+    }
+  }
+}
+
+void find_query_asteroid(State *state, CollisionQuery *query, f32 dt)
+{
+  // NOTE(lvl5): the candidates of all the wrap offsets of the query are in
+  // a row
+  u32 first = state->query_pair_first[query->query_id];
+  u32 end = state->query_pair_first[query->query_id + MAX_WRAP_OFFSET_COUNT];
+  query->cache_updates = state->query_cache_updates + first;
+  query->cache_update_count = 0;
+  query->cache_update_capacity = end - first;
+  for (u32 counter_index = 0; counter_index < FrameCounter_COUNT; counter_index++)
+  {
+    query->frame_counters[counter_index] = 0;
+  }
+  
+  if (query->is_swept)
+  {
+    find_first_swept_asteroid(state, query, dt);
+  }
+  else
+  {
+    find_colliding_asteroid(state, query);
+  }
+}
+
+// NOTE(lvl5): the part of a query that changes State, done on the main
+// thread in query order
+void apply_collision_query(State *state, CollisionQuery *query)
+{
+  for (u32 counter_index = 0; counter_index < FrameCounter_COUNT; counter_index++)
+  {
+    state->frame_counters[counter_index] += query->frame_counters[counter_index];
+  }
+  for (u32 update_index = 0; update_index < query->cache_update_count; update_index++)
+  {
+    SatCacheUpdate *update = query->cache_updates + update_index;
+    store_sat_cache_axis(&state->sat_cache, update->key, update->axis);
+  }
+}
+
+struct NarrowphaseJob
+{
+  State *state;
+  CollisionQuery *queries;
+  u32 query_count;
+  f32 dt;
+};
+
+WORKER_FN(find_query_asteroids_work)
+{
+  NarrowphaseJob *job = (NarrowphaseJob *)data;
+  for (u32 query_index = 0; query_index < job->query_count; query_index++)
+  {
+    find_query_asteroid(job->state, job->queries + query_index, job->dt);
+  }
+  return 0;
+}
+
+// NOTE(lvl5): runs every query against the asteroids as they were when the
+// frame's collisions started, split over the job system when there is one.
+// Only reads State, see apply_collision_query
+#define NARROWPHASE_JOB_QUERY_COUNT 16
+
+void find_query_asteroids(State *state, CollisionQuery *queries, u32 query_count,
+                          f32 dt, JobSystem *jobs)
+{
+  u32 job_count = (query_count + NARROWPHASE_JOB_QUERY_COUNT - 1)/NARROWPHASE_JOB_QUERY_COUNT;
+  NarrowphaseJob *narrowphase_jobs = alloc_array(NarrowphaseJob, job_count + 1);
+  
+  JobCounter counter = {};
+  for (u32 job_index = 0; job_index < job_count; job_index++)
+  {
+    NarrowphaseJob *job = narrowphase_jobs + job_index;
+    u32 start = job_index*NARROWPHASE_JOB_QUERY_COUNT;
+    job->state = state;
+    job->queries = queries + start;
+    job->query_count = query_count - start;
+    if (job->query_count > NARROWPHASE_JOB_QUERY_COUNT)
+    {
+      job->query_count = NARROWPHASE_JOB_QUERY_COUNT;
+    }
+    job->dt = dt;
+    
+    if (jobs)
+    {
+      platform_add_job(jobs, find_query_asteroids_work, job, &counter);
+    }
+    else
+    {
+      find_query_asteroids_work(job);
+    }
+  }
+  
+  if (jobs)
+  {
+    platform_wait_for_counter(jobs, &counter);
+  }
+}
+
+// NOTE(lvl5): bullets past moved_bullet_count were shot this frame after
+// move_bullets, they haven't moved
+v2 get_bullet_d_p(BulletArray *bullets, u32 index, u32 moved_bullet_count, f32 dt)
+{
+  v2 result = v2();
+  if (index < moved_bullet_count)
+  {
+    result = v2(bullets->d_p_x[index], bullets->d_p_y[index])*dt;
+  }
+  return result;
+}
+
+// NOTE(lvl5): drops the asteroids that are gone and refreshes the rest.
+// The ones that wrapped around the world since last frame are taken out and
+// go back in with the new ones, see sap_sort. Call it in the transient
+// context
+void update_sap_asteroids(State *state)
+{
+  SweepAndPrune *sap = &state->sap;
+  AsteroidArray *asteroids = &state->asteroids;
+  f32 max_move = state->game_area_size.x*0.5f;
+  
+  b32 *is_in_sap = alloc_array(b32, asteroids->count + 1);
+  for (u32 asteroid_index = 0; asteroid_index < asteroids->count; asteroid_index++)
+  {
+    is_in_sap[asteroid_index] = false;
+  }
+  SapEntry *moved = alloc_array(SapEntry, asteroids->count + 1);
+  u32 moved_count = 0;
+  
+  u32 item_count = 0;
+  for (u32 item_index = 0; item_index < sap->item_count; item_index++)
+  {
+    SapEntry item = sap->items[item_index];
+    u32 asteroid_index;
+    if (get_entity_index(state, item.key, EntityType_ASTEROID, &asteroid_index))
+    {
+      f32 old_min_x = item.aabb.min.x;
+      item.index = asteroid_index;
+      item.aabb = *get_asteroid_world_aabb(asteroids, asteroid_index);
+      if (fabsf(item.aabb.min.x - old_min_x) > max_move)
+      {
+        moved[moved_count++] = item;
+      }
+      else
+      {
+        sap->items[item_count++] = item;
+      }
+      is_in_sap[asteroid_index] = true;
+    }
+  }
+  sap->item_count = item_count;
+  
+  for (u32 asteroid_index = 0; asteroid_index < asteroids->count; asteroid_index++)
+  {
+    if (!is_in_sap[asteroid_index])
+    {
+      SapEntry *item = moved + moved_count++;
+      item->aabb = *get_asteroid_world_aabb(asteroids, asteroid_index);
+      item->key = get_asteroid_at(asteroids, asteroid_index)->handle;
+      item->index = asteroid_index;
+    }
+  }
+  
+  push_permanent_context(state); {
+    sap_reserve(sap, sap->item_count + moved_count);
+  }pop_context();
+  sap_sort(sap, moved, moved_count);
+}
+
+// NOTE(lvl5): new asteroids join the tree, the rest get their leaves moved
+// if they left them. Needs the permanent context, the tree may grow
+void update_tree_asteroids(State *state, f32 dt)
+{
+  AabbTree *tree = &state->tree;
+  AsteroidArray *asteroids = &state->asteroids;
+  for (u32 asteroid_index = 0; asteroid_index < asteroids->count; asteroid_index++)
+  {
+    Asteroid *asteroid = get_asteroid_at(asteroids, asteroid_index);
+    rect2 aabb = *get_asteroid_world_aabb(asteroids, asteroid_index);
+    if (asteroid->tree_proxy == AABB_TREE_NULL)
+    {
+      asteroid->tree_proxy = aabb_tree_insert(tree, aabb, asteroid_index);
+    }
+    else
+    {
+      aabb_tree_move(tree, asteroid->tree_proxy, aabb, asteroid->velocity*dt);
+    }
+  }
+}
+
+void add_sap_queries(State *state, u32 query_id, rect2 aabb,
+                     SapEntry *queries, u32 *query_count)
+{
+  v2 offsets[MAX_WRAP_OFFSET_COUNT];
+  u32 offset_count = get_wrap_offsets(aabb, state->query_wrap_bounds,
+                                      state->game_area_size, offsets);
+  for (u32 offset_index = 0; offset_index < offset_count; offset_index++)
+  {
+    SapEntry *query = queries + (*query_count)++;
+    query->aabb = move(aabb, offsets[offset_index]);
+    query->key = query_id + offset_index;
+    query->index = query_id + offset_index;
+  }
+}
+
+// NOTE(lvl5): grows pairs when needed, in the transient context
+void push_broadphase_pair(BroadphasePair **pairs, u32 *pair_count, u32 *pair_capacity,
+                          u32 query_index, u32 item_index)
+{
+  if (*pair_count == *pair_capacity)
+  {
+    u32 new_capacity = *pair_capacity*2;
+    BroadphasePair *new_pairs = alloc_array(BroadphasePair, new_capacity);
+    copy_memory(new_pairs, *pairs, *pair_count*sizeof(BroadphasePair));
+    *pairs = new_pairs;
+    *pair_capacity = new_capacity;
+  }
+  BroadphasePair *pair = *pairs + (*pair_count)++;
+  pair->query_index = query_index;
+  pair->item_index = item_index;
+}
+
+// NOTE(lvl5): the broadphase half of the collisions. Runs on the main
+// thread before the narrowphase, since the grid marks what it has already
+// handed out. Asks for the same aabbs find_colliding_asteroid and
+// find_first_swept_asteroid will, the pairs get bucketed by query id so the
+// narrowphase only has to read them
+void find_query_pairs(State *state, CollisionQuery *queries, u32 query_count, f32 dt)
+{
+  push_transient_context(state); {
+    state->query_id_count = get_query_id(state->bullets.count);
+    
+    BroadphasePair *pairs;
+    u32 pair_count;
+    if (state->broadphase == BroadphaseType_SWEEP_AND_PRUNE)
+    {
+      SapEntry *sap_queries = alloc_array(SapEntry, state->query_id_count);
+      u32 sap_query_count = 0;
+      for (u32 query_index = 0; query_index < query_count; query_index++)
+      {
+        CollisionQuery *query = queries + query_index;
+        add_sap_queries(state, query->query_id, get_collision_query_aabb(state, query, dt),
+                        sap_queries, &sap_query_count);
+      }
+      
+      u32 pair_capacity = sap_guess_pair_capacity(&state->sap, sap_query_count);
+      pairs = alloc_array(BroadphasePair, pair_capacity);
+      pair_count = sap_find_pairs(&state->sap, sap_queries, sap_query_count,
+                                  pairs, pair_capacity);
+      if (pair_count > pair_capacity)
+      {
+        pair_capacity = pair_count;
+        pairs = alloc_array(BroadphasePair, pair_capacity);
+        sap_find_pairs(&state->sap, sap_queries, sap_query_count, pairs, pair_capacity);
+      }
+    }
+    else
+    {
+      u32 pair_capacity = query_count*MAX_WRAP_OFFSET_COUNT*8 + 64;
+      pairs = alloc_array(BroadphasePair, pair_capacity);
+      pair_count = 0;
+      
+      u32 *candidates = state->query_result;
+      assert(candidates);
+      for (u32 query_index = 0; query_index < query_count; query_index++)
+      {
+        CollisionQuery *query = queries + query_index;
+        Shape *shape = get_shape(&state->shapes, query->shape);
+        rect2 aabb = get_collision_query_aabb(state, query, dt);
+        v2 offsets[MAX_WRAP_OFFSET_COUNT];
+        u32 offset_count = get_wrap_offsets(aabb, state->query_wrap_bounds,
+                                            state->game_area_size, offsets);
+        for (u32 offset_index = 0; offset_index < offset_count; offset_index++)
+        {
+          rect2 query_aabb = move(aabb, offsets[offset_index]);
+          u32 candidate_count;
+          if (state->broadphase == BroadphaseType_GRID)
+          {
+            candidate_count = grid_query(&state->grid, query_aabb, candidates,
+                                         state->grid.item_capacity);
+          }
+          else if (query->is_swept)
+          {
+            // NOTE(lvl5): the box the shape sweeps, grown by how far an
+            // asteroid can go, instead of the aabb around all of it. A lot
+            // less for anything that goes diagonally
+            rect2 end_aabb = get_shape_aabb(shape, translate(query->t, offsets[offset_index]));
+            f32 asteroid_reach = ASTEROID_SPEED_LIMIT*dt;
+            v2 extents = get_size(end_aabb)*0.5f + v2(asteroid_reach, asteroid_reach);
+            candidate_count = aabb_tree_query_segment(&state->tree,
+                                                      get_center(end_aabb) - query->d_p,
+                                                      query->d_p, extents, candidates,
+                                                      state->asteroids.count);
+          }
+          else
+          {
+            candidate_count = aabb_tree_query(&state->tree, query_aabb, candidates,
+                                              state->asteroids.count);
+          }
+          
+          for (u32 candidate_index = 0; candidate_index < candidate_count; candidate_index++)
+          {
+            push_broadphase_pair(&pairs, &pair_count, &pair_capacity,
+                                 query->query_id + offset_index, candidates[candidate_index]);
+          }
+        }
+      }
+    }
+    
+    u32 *first = alloc_array(u32, state->query_id_count + 1);
+    for (u32 query_id = 0; query_id <= state->query_id_count; query_id++)
+    {
+      first[query_id] = 0;
+    }
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      first[pairs[pair_index].query_index + 1]++;
+    }
+    for (u32 query_id = 0; query_id < state->query_id_count; query_id++)
+    {
+      first[query_id + 1] += first[query_id];
+    }
+    
+    u32 *items = alloc_array(u32, pair_count + 1);
+    u32 *next = alloc_array(u32, state->query_id_count);
+    copy_memory(next, first, state->query_id_count*sizeof(u32));
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      BroadphasePair *pair = pairs + pair_index;
+      items[next[pair->query_index]++] = pair->item_index;
+    }
+    
+    state->query_pair_first = first;
+    state->query_pair_items = items;
+    state->query_cache_updates = alloc_array(SatCacheUpdate, pair_count + 1);
+  }pop_context();
+}
+
+void alloc_particle_system(ParticleSystem *s, u32 capacity)
+{
+  capacity = (capacity + 3)/4*4;
+  s->items_capacity = capacity;
+  s->items_count = 0;
+  
+  s->p_x = alloc_array(f32, capacity);
+  s->p_y = alloc_array(f32, capacity);
+  s->scale = alloc_array(f32, capacity);
+  s->d_p_x = alloc_array(f32, capacity);
+  s->d_p_y = alloc_array(f32, capacity);
+  s->d_scale = alloc_array(f32, capacity);
+}
+
+void add_particles(ParticleSystem *s, u32 count, rect2 area, v2 min_direction, v2 max_direction)
+{
+  for (u32 particle_index = 0;
+       particle_index < count;
+       particle_index++)
+  {
+    if (s->items_count == s->items_capacity)
+    {
+      break;
+    }
+    u32 index = s->items_count++;
+    s->p_x[index] = random_range(&s->seed, area.min.x, area.max.x);
+    s->p_y[index] = random_range(&s->seed, area.min.y, area.max.y);
+    s->scale[index] = random_range(&s->seed, 0.2f, 0.3f);
+    
+    v2 direction = normalize(v2(random_range(&s->seed, min_direction.x, max_direction.x),
+                                random_range(&s->seed, min_direction.y, max_direction.y)));
+    v2 d_p = direction*random_range(&s->seed, 0.5f, 5.0f);
+    s->d_p_x[index] = d_p.x;
+    s->d_p_y[index] = d_p.y;
+    s->d_scale[index] = random_range(&s->seed, -0.2f, -2.5f);
+  }
+}
+
+
+// NOTE(lvl5): particles are simulated in fixed size chunks that can run on
+// any thread. A chunk only touches its own range of the particle arrays and
+// its own vertex output, the chunks are stitched back together in order on
+// the main thread, so the result doesn't depend on the thread count
+#define PARTICLE_CHUNK_SIZE 1024
+
+struct ParticleChunk
+{
+  ParticleSystem *system;
+  u32 start;
+  u32 count;
+  f32 dt;
+  m2x3 group_m;
+  
+  v2 *vertices;
+  u32 alive_count;
+};
+
+void simulate_particle_chunk(ParticleChunk *chunk)
+{
+  ParticleSystem *s = chunk->system;
+  u32 end = chunk->start + chunk->count;
+  f32x4 wide_dt = f32x4(chunk->dt);
+  
+  for (u32 index = chunk->start;
+       index < end;
+       index += 4)
+  {
+    v2x4 p = load_v2x4(s->p_x + index, s->p_y + index);
+    f32x4 scale = load_f32x4(s->scale + index);
+    
+    p += load_v2x4(s->d_p_x + index, s->d_p_y + index)*wide_dt;
+    scale = scale + load_f32x4(s->d_scale + index)*wide_dt;
+    
+    store(s->p_x + index, s->p_y + index, p);
+    store(s->scale + index, scale);
+  }
+  
+  // NOTE(lvl5): drop the dead ones in one pass, keeping the order
+  u32 alive_end = chunk->start;
+  for (u32 particle_index = chunk->start;
+       particle_index < end;
+       particle_index++)
+  {
+    if (s->scale[particle_index] > 0)
+    {
+      if (alive_end != particle_index)
+      {
+        s->p_x[alive_end] = s->p_x[particle_index];
+        s->p_y[alive_end] = s->p_y[particle_index];
+        s->scale[alive_end] = s->scale[particle_index];
+        s->d_p_x[alive_end] = s->d_p_x[particle_index];
+        s->d_p_y[alive_end] = s->d_p_y[particle_index];
+        s->d_scale[alive_end] = s->d_scale[particle_index];
+      }
+      alive_end++;
+    }
+  }
+  chunk->alive_count = alive_end - chunk->start;
+  
+  // NOTE(lvl5): emit 4 screen space corners per particle, all through the
+  // same group matrix
+  m2x3 m = chunk->group_m;
+  f32x4 one_half = f32x4(0.5f);
+  
+  for (u32 index = chunk->start;
+       index < alive_end;
+       index += 4)
+  {
+    v2x4 p = load_v2x4(s->p_x + index, s->p_y + index);
+    f32x4 half_size = load_f32x4(s->scale + index)*one_half;
+    
+    v2x4 min_p = p - v2x4(half_size, half_size);
+    v2x4 max_p = p + v2x4(half_size, half_size);
+    
+    v2x4 corners[4] = {
+      min_p,
+      v2x4(min_p.x, max_p.y),
+      max_p,
+      v2x4(max_p.x, min_p.y),
+    };
+    for (u32 corner_index = 0; corner_index < 4; corner_index++)
+    {
+      corners[corner_index] = m*corners[corner_index];
+    }
+    
+    store_quads(chunk->vertices + (index - chunk->start)*4, corners);
+  }
+}
+
+WORKER_FN(simulate_particle_chunk_work)
+{
+  simulate_particle_chunk((ParticleChunk *)data);
+  return 0;
+}
+
+void simulate_and_draw_particles(ParticleSystem *s, RenderGroup *group, f32 dt,
+                                 JobSystem *jobs)
+{
+  if (s->items_count == 0)
+  {
+    return;
+  }
+  
+  u32 chunk_count = (s->items_count + PARTICLE_CHUNK_SIZE - 1)/PARTICLE_CHUNK_SIZE;
+  ParticleChunk *chunks = alloc_array(ParticleChunk, chunk_count);
+  v2 *vertices = alloc_array(v2, chunk_count*PARTICLE_CHUNK_SIZE*4);
+  
+  m2x3 group_m = transform_to_m2x3(group->transform);
+  
+  JobCounter counter = {};
+  for (u32 chunk_index = 0;
+       chunk_index < chunk_count;
+       chunk_index++)
+  {
+    ParticleChunk *chunk = chunks + chunk_index;
+    chunk->system = s;
+    chunk->start = chunk_index*PARTICLE_CHUNK_SIZE;
+    chunk->count = s->items_count - chunk->start;
+    if (chunk->count > PARTICLE_CHUNK_SIZE)
+    {
+      chunk->count = PARTICLE_CHUNK_SIZE;
+    }
+    chunk->dt = dt;
+    chunk->group_m = group_m;
+    chunk->vertices = vertices + chunk->start*4;
+    chunk->alive_count = 0;
+    
+    if (jobs)
+    {
+      platform_add_job(jobs, simulate_particle_chunk_work, chunk, &counter);
+    }
+    else
+    {
+      simulate_particle_chunk(chunk);
+    }
+  }
+  
+  if (jobs)
+  {
+    platform_wait_for_counter(jobs, &counter);
+  }
+  
+  u32 alive_count = 0;
+  for (u32 chunk_index = 0;
+       chunk_index < chunk_count;
+       chunk_index++)
+  {
+    ParticleChunk *chunk = chunks + chunk_index;
+    if (alive_count != chunk->start)
+    {
+      for (u32 offset = 0; offset < chunk->alive_count; offset++)
+      {
+        u32 from = chunk->start + offset;
+        u32 to = alive_count + offset;
+        s->p_x[to] = s->p_x[from];
+        s->p_y[to] = s->p_y[from];
+        s->scale[to] = s->scale[from];
+        s->d_p_x[to] = s->d_p_x[from];
+        s->d_p_y[to] = s->d_p_y[from];
+        s->d_scale[to] = s->d_scale[from];
+      }
+    }
+    alive_count += chunk->alive_count;
+    
+    if (chunk->alive_count)
+    {
+      push_quads(group, chunk->vertices, chunk->alive_count, COLOR_RED);
+    }
+  }
+  s->items_count = alive_count;
+}
+
+void generate_asteroids(State *state)
+{
+  if (state->stress_asteroid_count)
+  {
+    // NOTE(lvl5): small enough that shooting them doesn't split them
+    for (u32 asteroid_index = 0;
+         asteroid_index < state->stress_asteroid_count;
+         asteroid_index++)
+    {
+      v2 random_p = v2(random_bilateral(&state->seed),
+                       random_bilateral(&state->seed))*0.5f;
+      v2 p = hadamard(random_p, state->game_area_size);
+      add_asteroid(state, p, 0.5f);
+    }
+    return;
+  }
+  
+  for (u32 asteroid_index = 0;
+       asteroid_index < state->asteroids_per_wave;
+       asteroid_index++)
+  {
+    v2 random_p = v2(-0.5f, 0.5f);//v2(random_bilateral(&state->seed),
+    //random_bilateral(&state->seed));
+    v2 p = hadamard(random_p, state->game_area_size);
+    add_asteroid(state, p, 2.5f);
+  }
+  
+  state->asteroids_per_wave += 2;
+}
 
 GAME_UPDATE(game_update)
 {
@@ -511,26 +2121,36 @@ GAME_UPDATE(game_update)
   if (!state->initialized)
   {
     *state = {};
-    u64 permanent_memory_size = megabytes(16);
-    u64 transient_memory_size = memory->size - sizeof(state) -
+    // NOTE(lvl5): entity chunks live in the permanent arena, so it gets
+    // half of what's left
+    u64 permanent_memory_size = (memory->size - sizeof(State))/2;
+    u64 transient_memory_size = memory->size - sizeof(State) -
       permanent_memory_size;
     init(&state->arena, memory->data + sizeof(State), permanent_memory_size);
     init(&state->transient_arena, memory->data + sizeof(State) + permanent_memory_size, transient_memory_size);
     
     
-    LocalContext ctx = make_context(get_local_context());
-    ctx.allocator = arena_allocator;
-    ctx.allocator_data = &state->arena;
-    push_context(ctx); {
+    push_permanent_context(state); {
       state->initialized = true;
+      state->stress_asteroid_count = memory->stress_asteroid_count;
+      state->broadphase = memory->broadphase;
       state->seed = make_random_sequence(3153273742);
       state->particle_system.seed = make_random_sequence(54625634);
       state->render_group = {};
       state->render_group.transform.scale = meters_to_screen_space(screen, v2(1, 1));
+      state->render_group.shapes = &state->shapes;
+      
+      // NOTE(lvl5): starts at 2 so the zeroed entries read as stale
+      state->sat_cache.entries = alloc_array(SatCacheEntry, SAT_CACHE_SIZE);
+      for (u32 entry_index = 0; entry_index < SAT_CACHE_SIZE; entry_index++)
+      {
+        state->sat_cache.entries[entry_index] = {};
+      }
+      state->sat_cache.frame_index = 2;
       
-      state->particle_system.items_capacity = 10000;
-      state->particle_system.items = alloc_array(Particle,
-                                                 state->particle_system.items_capacity);
+      aabb_tree_init(&state->tree);
+      
+      alloc_particle_system(&state->particle_system, 65536);
       
 #define SHADER_LOC "shaders/basic.glsl"
       
@@ -540,14 +2160,32 @@ GAME_UPDATE(game_update)
       
       state->game_area_size = screen->size / PIXELS_PER_METER;
       
-      Entity *zero_entity = add_entity(state, EntityType_NONE);
+      init_shape_pool(&state->shapes, ASTEROID_SHAPE_COUNT + 2);
+      
+      Polygon player_shape;
+      player_shape.count = 3;
+      player_shape.vertices[0] = v2(0.4f, 0.0f);
+      player_shape.vertices[1] = v2(-0.4f, 0.3f);
+      player_shape.vertices[2] = v2(-0.4f, -0.3f);
+      
+      Player *player = &state->player;
+      player->t.scale = v2(1, 1);
+      player->shape = add_shape(&state->shapes, &player_shape);
+      player->handle = add_entity_slot(state, EntityType_PLAYER, 0);
+      
+      Polygon bullet_shape = rect2_to_polygon(rect_center_size(v2(), v2(0.4f, 0.4f)));
+      state->bullet_shape = add_shape(&state->shapes, &bullet_shape);
       
-      Entity *player = add_entity(state, EntityType_PLAYER);
-      Polygon *poly = &player->shape;
-      poly->count = 3;
-      poly->vertices[0] = v2(0.4f, 0.0f);
-      poly->vertices[1] = v2(-0.4f, 0.3f);
-      poly->vertices[2] = v2(-0.4f, -0.3f);
+      state->first_asteroid_shape = (ShapeIndex)state->shapes.count;
+      for (u32 shape_index = 0;
+           shape_index < ASTEROID_SHAPE_COUNT;
+           shape_index++)
+      {
+        u32 vertex_count = (u32)random_range_i32(&state->seed, 4, 16);
+        Polygon asteroid_shape = generate_random_convex_polygon(&state->seed, vertex_count, 1.0f);
+        add_shape(&state->shapes, &asteroid_shape);
+        reset_temp_storage();
+      }
       
       state->asteroids_per_wave = 4;
       generate_asteroids(state);
@@ -556,14 +2194,74 @@ GAME_UPDATE(game_update)
   
   f32 dt = input->delta_time;
   RenderGroup *render_group = &state->render_group;
+  Player *player = &state->player;
+  AsteroidArray *asteroids = &state->asteroids;
+  BulletArray *bullets = &state->bullets;
+  
+  for (u32 counter_index = 0; counter_index < FrameCounter_COUNT; counter_index++)
+  {
+    state->frame_counters[counter_index] = 0;
+  }
   
   u64 render_memory_mark = get_mark(&state->transient_arena);
+  BEGIN_TIMED_PHASE(MOVEMENT);
+  v2 camera_scale = screen_space_to_meters(screen, v2(1, 1));
+  rect2 camera_rect = rescale_centered(rect_center_size(-render_group->transform.p, v2(2, 2)), camera_scale);
+  
+  v2 area = state->game_area_size;
+  // NOTE(lvl5): only counted to size the render buffer, the copies are
+  // drawn straight from the entities
+  u32 wrap_copy_count = 0;
+  
+  player->t.p = wrap_position(player->t.p + player->velocity*dt, area);
+  wrap_copy_count += count_wrap_copies(get_world_aabb(state, player->shape, player->t),
+                                       camera_rect, area);
+  
+  for (u32 asteroid_index = 0;
+       asteroid_index < asteroids->count;
+       asteroid_index++)
+  {
+    Asteroid *asteroid = get_asteroid_at(asteroids, asteroid_index);
+    asteroid->t.p = wrap_position(asteroid->t.p + asteroid->velocity*dt, area);
+    asteroid->t.angle += asteroid->angular_velocity*dt;
+    
+    update_asteroid_world_aabb(state, asteroid_index);
+    wrap_copy_count += count_wrap_copies(*get_asteroid_world_aabb(asteroids, asteroid_index),
+                                         camera_rect, area);
+  }
+  
+  move_bullets(bullets, dt, area);
+  u32 moved_bullet_count = bullets->count;
+  for (u32 bullet_index = 0;
+       bullet_index < bullets->count;
+       bullet_index++)
+  {
+    rect2 aabb = get_world_aabb(state, state->bullet_shape,
+                                get_bullet_transform(bullets, bullet_index));
+    wrap_copy_count += count_wrap_copies(aabb, camera_rect, area);
+  }
+  END_TIMED_PHASE(memory, MOVEMENT);
+  
+  
   push_transient_context(state);{
-    alloc_render_group_buffer(&state->render_group, screen, megabytes(5));
+    // NOTE(lvl5): room for every entity and its wrapped copies, plus the
+    // asteroids split and the bullet fired during the update, which can
+    // wrap any way they like
+    u32 entity_count = asteroids->count + bullets->count + 1;
+    u32 entry_count = entity_count*3 + wrap_copy_count +
+      (bullets->count*2 + 2)*MAX_WRAP_OFFSET_COUNT;
+    u64 render_buffer_size = megabytes(5) +
+      entry_count*(sizeof(RenderEntryShape) + sizeof(RenderEntryType));
+    alloc_render_group_buffer(&state->render_group, screen, (u32)render_buffer_size);
   }pop_context();
   
   
-  simulate_and_draw_particles(&state->particle_system, render_group, dt);
+  BEGIN_TIMED_PHASE(PARTICLES);
+  push_transient_context(state); {
+    simulate_and_draw_particles(&state->particle_system, render_group, dt,
+                                memory->job_system);
+  }pop_context();
+  END_TIMED_PHASE(memory, PARTICLES);
   
   if (state->screenshake_timer >= 0)
   {
@@ -572,229 +2270,283 @@ GAME_UPDATE(game_update)
     state->screenshake_timer -= dt;
   }
   
+  push_polygon(render_group, rect2_to_polygon(camera_rect), default_transform(), COLOR_WHITE);
   
-  for (u32 entitiy_index = 1;
-       entitiy_index < state->entities_count;
-       entitiy_index++)
-  {
-    Entity *e = get_entity(state, entitiy_index);
-    if (e)
+  
+  BEGIN_TIMED_PHASE(ENTITY_UPDATE);
+  push_transient_context(state); {
+    // NOTE(lvl5): asteroids split during the update only join the
+    // broadphase next frame, so it only needs room for what is there now
+    u32 item_capacity = asteroids->count + 1;
+    u32 node_count = 0;
+    rect2 reach = inverted_infinity_rect2();
+    for (u32 asteroid_index = 0;
+         asteroid_index < asteroids->count;
+         asteroid_index++)
+    {
+      rect2 aabb = *get_asteroid_world_aabb(asteroids, asteroid_index);
+      v2 size = get_size(aabb);
+      node_count += ((u32)(size.x/GRID_CELL_SIZE) + 2)*((u32)(size.y/GRID_CELL_SIZE) + 2);
+      
+      if (aabb.min.x < reach.min.x) reach.min.x = aabb.min.x;
+      if (aabb.min.y < reach.min.y) reach.min.y = aabb.min.y;
+      if (aabb.max.x > reach.max.x) reach.max.x = aabb.max.x;
+      if (aabb.max.y > reach.max.y) reach.max.y = aabb.max.y;
+    }
+    // NOTE(lvl5): something left of reach.max - area can touch an asteroid
+    // on the right side shifted over by area, and the other way around
+    state->query_wrap_bounds.min = reach.max - state->game_area_size;
+    state->query_wrap_bounds.max = reach.min + state->game_area_size;
+    
+    if (state->broadphase == BroadphaseType_GRID)
     {
-      if (!e->is_temporary)
+      rect2 grid_bounds = rect_center_size(v2(), state->game_area_size + 
+                                           v2(2, 2)*GRID_CELL_SIZE);
+      grid_begin(&state->grid, grid_bounds, GRID_CELL_SIZE,
+                 item_capacity, node_count);
+      state->query_result = alloc_array(u32, item_capacity);
+      
+      for (u32 asteroid_index = 0;
+           asteroid_index < asteroids->count;
+           asteroid_index++)
       {
-        v2 area = state->game_area_size;
-        v2 half_area = area*0.5f;
-        
-        e->t.p += e->velocity*dt;
-        e->t.angle += e->angular_velocity*dt;
-        
-        if (e->t.p.x > half_area.x)
-        {
-          e->t.p.x -= area.x;
-        }
-        if (e->t.p.x < -half_area.x)
-        {
-          e->t.p.x += area.x;
-        }
-        if (e->t.p.y > half_area.y)
-        {
-          e->t.p.y -= area.y;
-        }
-        if (e->t.p.y < -half_area.y)
-        {
-          e->t.p.y += area.y;
-        }
-        
-        v2 camera_scale = screen_space_to_meters(screen, v2(1, 1));
-        rect2 camera_rect = rescale_centered(rect_center_size(-render_group->transform.p, v2(2, 2)), camera_scale);
-        push_polygon(render_group, rect2_to_polygon(camera_rect), default_transform(), COLOR_WHITE);
-        
-        rect2 aabb = polygon_to_aabb(transform_polygon(e->shape, e->t));
-        
-        b32 right_side = aabb.max.x > camera_rect.max.x;
-        b32 top_side = aabb.max.y > camera_rect.max.y;
-        b32 left_side = aabb.min.x < camera_rect.min.x;
-        b32 bottom_side = aabb.min.y < camera_rect.min.y;
-        
-        
-        rect2 area_rect = rect_center_size(v2(), area*2);
-        
-        if (right_side)
-          add_temporary_clone(state, e, e->t.p + v2(area_rect.min.x, 0.0f));
-        
-        if (left_side)
-          add_temporary_clone(state, e, e->t.p + v2(area_rect.max.x, 0.0f));
-        
-        if (bottom_side)
-          add_temporary_clone(state, e, e->t.p + v2(0.0f, area_rect.max.y));
-        
-        if (top_side)
-          add_temporary_clone(state, e, e->t.p + v2(0.0f, area_rect.min.y));
-        
-        if (bottom_side && right_side)
-          add_temporary_clone(state, e, e->t.p + v2(area_rect.min.x,
-                                                    area_rect.max.y));
-        
-        if (top_side && left_side)
-          add_temporary_clone(state, e, e->t.p + v2(area_rect.max.x,
-                                                    area_rect.min.y));
-        
-        if (top_side && right_side)
-          add_temporary_clone(state, e, e->t.p + v2(area_rect.min.x,
-                                                    area_rect.min.y));
-        
-        if (bottom_side && left_side)
-          add_temporary_clone(state, e, e->t.p + v2(area_rect.max.x,
-                                                    area_rect.max.y));
+        grid_insert(&state->grid, asteroid_index, *get_asteroid_world_aabb(asteroids, asteroid_index));
       }
     }
-  }
-  
+    else if (state->broadphase == BroadphaseType_AABB_TREE)
+    {
+      state->query_result = alloc_array(u32, asteroids->count + 1);
+      push_permanent_context(state); {
+        update_tree_asteroids(state, dt);
+      }pop_context();
+    }
+    else
+    {
+      update_sap_asteroids(state);
+    }
+  }pop_context();
   
-  for (u32 entitiy_index = 1;
-       entitiy_index < state->entities_count;
-       entitiy_index++)
+  if (!player->is_removed)
   {
-    Entity *e = get_entity(state, entitiy_index);
-    if (e)
+    if (input->left.is_down)
     {
-      if (!e->is_temporary)
-      {
-        switch (e->type)
-        {
-          case EntityType_PLAYER:
-          {
-            if (input->left.is_down)
-            {
-              e->t.angle += 4.5f*dt;
-            }
-            if (input->right.is_down)
-            {
-              e->t.angle -= 4.5f*dt;
-            }
-            
-            f32 MIN_SCALE = 1;
-            f32 MAX_SCALE = 1;
-            static f32 current_scale = 1;
-            
-            if (input->up.is_down)
-            {
-              v2 accel = rotate(v2(9.0f, 0.0f), e->t.angle);
-              e->velocity += accel*dt;
-              
-              f32 particle_spread = random_range(&state->seed, -0.15f, 0.15f);
-              v2 particle_direction = rotate(v2(1.0f, particle_spread),
-                                             e->t.angle + PI);
-              
-              v2 particle_p = rotate(v2(-0.5f, 0.0f), e->t.angle) + e->t.p;
-              add_particles(&state->particle_system, 5, rect_center_size(particle_p, v2(0, 0)),
-                            particle_direction, particle_direction);
-              
-              f32 dist = MIN_SCALE - current_scale;
-              current_scale += dist*0.03f;
-            } 
-            else
-            {
-              f32 dist = MAX_SCALE - current_scale;
-              current_scale += dist*0.03f;
-            }
-            render_group->transform.scale = meters_to_screen_space(screen, v2(1, 1))*current_scale;
-            
-            b32 can_fire = e->player.shot_cooldown <= 0;
-            
+      player->t.angle += 4.5f*dt;
+    }
+    if (input->right.is_down)
+    {
+      player->t.angle -= 4.5f*dt;
+    }
+    
+    f32 MIN_SCALE = 1;
+    f32 MAX_SCALE = 1;
+    static f32 current_scale = 1;
+    
+    if (input->up.is_down)
+    {
+      v2 accel = rotate(v2(9.0f, 0.0f), player->t.angle);
+      player->velocity += accel*dt;
+      
+      f32 particle_spread = random_range(&state->seed, -0.15f, 0.15f);
+      v2 particle_direction = rotate(v2(1.0f, particle_spread),
+                                     player->t.angle + PI);
+      
+      v2 particle_p = rotate(v2(-0.5f, 0.0f), player->t.angle) + player->t.p;
+      add_particles(&state->particle_system, 5, rect_center_size(particle_p, v2(0, 0)),
+                    particle_direction, particle_direction);
+      
+      f32 dist = MIN_SCALE - current_scale;
+      current_scale += dist*0.03f;
+    } 
+    else
+    {
+      f32 dist = MAX_SCALE - current_scale;
+      current_scale += dist*0.03f;
+    }
+    render_group->transform.scale = meters_to_screen_space(screen, v2(1, 1))*current_scale;
+    
+    b32 can_fire = player->shot_cooldown <= 0;
+    
 #if 1
-            if (input->space.is_down && can_fire)
-            {
-              v2 bullet_vel = rotate(v2(15.0f, 0.0f), e->t.angle);
-              add_bullet(state, e->t.p, e->velocity + bullet_vel, e->t.angle);
-              e->player.shot_cooldown = 0.15f;
-            }
+    if (input->space.is_down && can_fire)
+    {
+      v2 bullet_vel = rotate(v2(15.0f, 0.0f), player->t.angle);
+      add_bullet(state, player->t.p, player->velocity + bullet_vel, player->t.angle);
+      player->shot_cooldown = 0.15f;
+    }
 #else
-            if (input->space.is_down)
-            {
-              e->velocity = v2();
-            }
+    if (input->space.is_down)
+    {
+      player->velocity = v2();
+    }
 #endif
-            e->player.shot_cooldown -= dt;
-            
-            if (len_sqr(e->velocity) > sqr(SHIP_SPEED_LIMIT))
-            {
-              e->velocity = normalize(e->velocity)*SHIP_SPEED_LIMIT;
-            }
-            
-            Entity *other = check_collision(state, e, EntityType_ASTEROID);
-            if (other)
-            {
-              remove_entity(state, e);
-              state->initialized = false;
-            }
-          } break;
-          
-          case EntityType_ASTEROID:
-          {
-          } break;
-          
-          case EntityType_BULLET:
-          {
-            e->bullet.lifetime -= dt;
-            if (e->bullet.lifetime <= 0)
-            {
-              remove_entity(state, e);
-              break;
-            }
-            
-            Entity *other = check_collision(state, e, EntityType_ASTEROID);
-            if (other)
-            {
-              state->screenshake_timer = 0.2f;
-              add_particles(&state->particle_system, 100, rect_center_size(e->t.p, v2(0, 0)),
-                            v2(-1, -1), v2(1, 1));
-              v2 new_p = other->t.p;
-              
-              f32 new_scale = other->asteroid.scale*0.5f;
-              if (new_scale >= 0.5)
-              {
-                add_asteroid(state, new_p, new_scale);
-                add_asteroid(state, new_p, new_scale);
-              }
-              
-              remove_entity(state, e);
-              remove_entity(state, other);
-              state->asteroid_count--;
-            }
-            
-          } break;
+    player->shot_cooldown -= dt;
+    
+    if (len_sqr(player->velocity) > sqr(SHIP_SPEED_LIMIT))
+    {
+      player->velocity = normalize(player->velocity)*SHIP_SPEED_LIMIT;
+    }
+    
+  }
+  
+  push_transient_context(state); {
+    CollisionQuery *queries = alloc_array(CollisionQuery, bullets->count + 1);
+    u32 query_count = 0;
+    if (!player->is_removed)
+    {
+      CollisionQuery *query = queries + query_count++;
+      query->type = EntityType_PLAYER;
+      query->index = 0;
+      query->handle = player->handle;
+      query->query_id = PLAYER_QUERY_ID;
+      query->shape = player->shape;
+      query->t = player->t;
+      query->d_p = v2();
+      query->is_swept = false;
+    }
+    
+    for (u32 bullet_index = 0;
+         bullet_index < bullets->count;
+         bullet_index++)
+    {
+      if (bullets->lifetime[bullet_index] <= 0)
+      {
+        remove_bullet(state, bullet_index);
+        continue;
+      }
+      
+      CollisionQuery *query = queries + query_count++;
+      query->type = EntityType_BULLET;
+      query->index = bullet_index;
+      query->handle = bullets->handle[bullet_index];
+      query->query_id = get_query_id(bullet_index);
+      query->shape = state->bullet_shape;
+      query->t = get_bullet_transform(bullets, bullet_index);
+      query->d_p = get_bullet_d_p(bullets, bullet_index, moved_bullet_count, dt);
+      query->is_swept = true;
+    }
+    
+    find_query_pairs(state, queries, query_count, dt);
+    find_query_asteroids(state, queries, query_count, dt, memory->job_system);
+    for (u32 query_index = 0; query_index < query_count; query_index++)
+    {
+      apply_collision_query(state, queries + query_index);
+    }
+    
+    for (u32 query_index = 0; query_index < query_count; query_index++)
+    {
+      CollisionQuery *query = queries + query_index;
+      if (query->asteroid_index == ASTEROID_NONE)
+      {
+        continue;
+      }
+      
+      if (query->type == EntityType_PLAYER)
+      {
+        if (!state->stress_asteroid_count)
+        {
+          player->is_removed = true;
+          state->initialized = false;
+        }
+        continue;
+      }
+      
+      // NOTE(lvl5): an earlier bullet already broke the asteroid this one
+      // hit first, see what else it hits now
+      if (get_asteroid_at(asteroids, query->asteroid_index)->is_removed)
+      {
+        find_query_asteroid(state, query, dt);
+        apply_collision_query(state, query);
+        if (query->asteroid_index == ASTEROID_NONE)
+        {
+          continue;
         }
       }
       
-      draw_entity(render_group, e);
+      u32 bullet_index = query->index;
+      Asteroid *other = get_asteroid_at(asteroids, query->asteroid_index);
+      v2 bullet_p = query->t.p - query->d_p*(1 - query->hit_t);
+      
+      state->screenshake_timer = 0.2f;
+      add_particles(&state->particle_system, 100, rect_center_size(bullet_p, v2(0, 0)),
+                    v2(-1, -1), v2(1, 1));
+      v2 new_p = other->t.p;
+      
+      f32 new_scale = other->scale*0.5f;
+      remove_bullet(state, bullet_index);
+      remove_asteroid(state, query->asteroid_index);
+      
+      if (new_scale >= 0.5)
+      {
+        // NOTE(lvl5): can grow a new chunk, don't hold on to other
+        add_asteroid(state, new_p, new_scale);
+        add_asteroid(state, new_p, new_scale);
+      }
     }
-  }
+  }pop_context();
   
+  for (u32 asteroid_index = 0;
+       asteroid_index < asteroids->count;
+       asteroid_index++)
+  {
+    Asteroid *asteroid = get_asteroid_at(asteroids, asteroid_index);
+    if (!asteroid->is_removed)
+    {
+      push_wrapped_shape(render_group, asteroid->shape, asteroid->t,
+                         *get_asteroid_world_aabb(asteroids, asteroid_index),
+                         camera_rect, area, COLOR_WHITE);
+    }
+  }
   
-  for (u32 entitiy_index = 1;
-       entitiy_index < state->entities_count;
-       entitiy_index++)
+  for (u32 bullet_index = 0;
+       bullet_index < bullets->count;
+       bullet_index++)
   {
-    Entity *e = get_entity(state, entitiy_index);
-    if (e->is_temporary)
+    if (!bullets->is_removed[bullet_index])
     {
-      remove_entity(state, e);
+      Transform t = get_bullet_transform(bullets, bullet_index);
+      push_wrapped_shape_rect(render_group, state->bullet_shape, t,
+                              get_world_aabb(state, state->bullet_shape, t),
+                              camera_rect, area, COLOR_WHITE);
     }
   }
   
-  if (state->asteroid_count == 0)
+  if (!player->is_removed)
+  {
+    push_wrapped_shape(render_group, player->shape, player->t,
+                       get_world_aabb(state, player->shape, player->t),
+                       camera_rect, area, COLOR_WHITE);
+  }
+  state->grid = {};
+  state->query_result = 0;
+  state->query_pair_first = 0;
+  state->query_pair_items = 0;
+  state->query_cache_updates = 0;
+  END_TIMED_PHASE(memory, ENTITY_UPDATE);
+  
+  
+  flush_removed_asteroids(state);
+  flush_removed_bullets(state);
+  
+  if (asteroids->count == 0)
   {
     generate_asteroids(state);
   }
   
+  BEGIN_TIMED_PHASE(RENDER);
   push_transient_context(state); {
     draw_render_group(render_group, state->shader);
   }pop_context();
+  END_TIMED_PHASE(memory, RENDER);
   
   set_mark(&state->transient_arena, render_memory_mark);
   
   render_group->transform.angle = 0;
   
+  for (u32 counter_index = 0; counter_index < FrameCounter_COUNT; counter_index++)
+  {
+    memory->frame_counters[counter_index] = state->frame_counters[counter_index];
+  }
+  state->sat_cache.frame_index++;
+  
   reset_temp_storage();
 }
@@ -2,6 +2,7 @@
 #define ASTEROIDS_H
 
 #include "renderer.h"
+#include "broadphase.h"
 
 enum EntityType
 {
@@ -11,70 +12,266 @@ enum EntityType
   EntityType_BULLET,
 };
 
-struct Particle
-{
-  Transform t;
-  
-  v2 d_p;
-  v2 d_scale;
-};
-
+// NOTE(lvl5): particles are stored as separate arrays so they can be
+// integrated 4 at a time. Particles are always square and never rotate.
+// items_capacity is a multiple of 4 and lanes past items_count are junk
 struct ParticleSystem
 {
-  Particle *items;
+  f32 *p_x;
+  f32 *p_y;
+  f32 *scale;
+  
+  f32 *d_p_x;
+  f32 *d_p_y;
+  f32 *d_scale;
+  
   u32 items_capacity;
   u32 items_count;
   
   RandomSequence seed;
 };
 
-struct EntityPlayer
+// NOTE(lvl5): the low ENTITY_INDEX_BITS bits pick a slot, the rest is the
+// generation the slot had when the handle was made. Removing an entity bumps
+// the generation of its slot, so old handles to it stop resolving.
+// Slot 0 is never handed out, so handle 0 is never valid
+typedef u32 EntityHandle;
+
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_INDEX_MASK ((1 << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_GENERATION_MASK (U32_MAX >> ENTITY_INDEX_BITS)
+#define ENTITY_NULL_HANDLE 0
+#define ENTITY_SLOT_NONE 0
+
+// NOTE(lvl5): storage grows in chunks of ENTITY_CHUNK_SIZE that come from
+// State::arena and never move
+#define ENTITY_CHUNK_SHIFT 8
+#define ENTITY_CHUNK_SIZE (1 << ENTITY_CHUNK_SHIFT)
+#define ENTITY_CHUNK_MASK (ENTITY_CHUNK_SIZE - 1)
+#define MAX_ENTITY_CHUNK_COUNT ((1 << ENTITY_INDEX_BITS)/ENTITY_CHUNK_SIZE)
+
+struct EntitySlot
 {
-  f32 shot_cooldown;
+  // NOTE(lvl5): index into the array of its type while in use, the next
+  // free slot after that
+  u32 dense_index;
+  u32 generation;
+  EntityType type;
 };
 
-struct EntityBullet
+struct EntitySlotChunk
 {
-  f32 lifetime;
+  EntitySlot slots[ENTITY_CHUNK_SIZE];
 };
 
-struct EntityAsteroid
+struct EntitySlots
 {
-  f32 scale;
+  EntitySlotChunk *chunks[MAX_ENTITY_CHUNK_COUNT];
+  u32 chunk_count;
+  u32 count;
+  u32 first_free;
 };
 
-struct Entity
+/*
+every entity type lives in its own dense array with only the fields it needs,
+so the update loops don't branch on the type. Removing an entity only flags
+it, the flush at the end of the frame slides the survivors of that array down
+in one pass, so indices stay good for the whole frame and the order never
+changes.
+*/
+
+struct Player
 {
-  b32 is_temporary;
-  b32 exists;
-  EntityType type;
-  
-  Polygon shape;
+  EntityHandle handle;
+  b32 is_removed;
   Transform t;
+  v2 velocity;
+  f32 shot_cooldown;
   
+  ShapeIndex shape;
+};
+
+struct Asteroid
+{
+  EntityHandle handle;
+  b32 is_removed;
+  Transform t;
   v2 velocity;
   f32 angular_velocity;
+  f32 scale;
+  
+  ShapeIndex shape;
+  // NOTE(lvl5): leaf in State::tree, AABB_TREE_NULL until it joins
+  u32 tree_proxy;
+};
+
+// NOTE(lvl5): what shape_to_soa moves the vertices and the normals of a
+// shape with, see get_soa_transform
+struct SoaTransform
+{
+  m2x3 m;
+  m2x3 normal_m;
+};
+
+struct AsteroidChunk
+{
+  Asteroid asteroids[ENTITY_CHUNK_SIZE];
+  
+  // NOTE(lvl5): recomputed once per frame when asteroids move, from the
+  // radius of the shape
+  rect2 world_aabbs[ENTITY_CHUNK_SIZE];
+  // NOTE(lvl5): refreshed with world_aabbs, so the collision tests don't
+  // redo the sin and cos for every pair an asteroid is in
+  SoaTransform soa_transforms[ENTITY_CHUNK_SIZE];
+};
+
+struct AsteroidArray
+{
+  AsteroidChunk *chunks[MAX_ENTITY_CHUNK_COUNT];
+  u32 chunk_count;
+  u32 count;
   
-  union
-  {
-    EntityPlayer player;
-    EntityBullet bullet;
-    EntityAsteroid asteroid;
-  };
+  u32 removed_count;
+  u32 first_removed_index;
+};
+
+// NOTE(lvl5): bullets are separate arrays so they can be moved 8 at a time,
+// like particles. All bullets share State::bullet_shape, only the angle differs.
+// Lanes past count are junk, MAX_BULLET_COUNT is a multiple of 8 so they
+// stay inside the arrays
+#define MAX_BULLET_COUNT 256
+
+struct BulletArray
+{
+  alignas(16) f32 p_x[MAX_BULLET_COUNT];
+  alignas(16) f32 p_y[MAX_BULLET_COUNT];
+  alignas(16) f32 d_p_x[MAX_BULLET_COUNT];
+  alignas(16) f32 d_p_y[MAX_BULLET_COUNT];
+  alignas(16) f32 lifetime[MAX_BULLET_COUNT];
+  f32 angle[MAX_BULLET_COUNT];
+  EntityHandle handle[MAX_BULLET_COUNT];
+  b32 is_removed[MAX_BULLET_COUNT];
+  u32 count;
+  
+  u32 removed_count;
+  u32 first_removed_index;
+};
+
+#define ASTEROID_SHAPE_COUNT 64
+
+// NOTE(lvl5): the axis that last separated a pair of entities, keyed by
+// both handles. Things that were apart last frame are almost always apart
+// on the same axis this frame, so it gets tried first. Entries not touched
+// since the frame before are treated as empty and get overwritten
+#define SAT_CACHE_SIZE 4096
+#define SAT_CACHE_PROBE_COUNT 4
+
+struct SatCacheEntry
+{
+  u64 key;
+  v2 axis;
+  u32 frame_index;
+};
+
+struct SatCache
+{
+  SatCacheEntry *entries;
+  u32 frame_index;
+};
+
+struct SatCacheUpdate
+{
+  u64 key;
+  v2 axis;
+};
+
+/*
+a shape looking for the asteroid it hits this frame, the player or a
+bullet. All of them are found before any of them is handled: the
+narrowphase may run on any thread and only reads State, everything it would
+change goes in the query and is applied on the main thread in query order.
+So the frame comes out the same however the work was split
+*/
+
+struct CollisionQuery
+{
+  EntityType type;
+  // NOTE(lvl5): into the array of type
+  u32 index;
+  EntityHandle handle;
+  u32 query_id;
+  ShapeIndex shape;
+  Transform t;
+  // NOTE(lvl5): how far it moved this frame to get to t, only looked at when
+  // is_swept
+  v2 d_p;
+  b32 is_swept;
+  
+  u32 asteroid_index;
+  // NOTE(lvl5): fraction of the frame when it hit, for swept queries
+  f32 hit_t;
+  u32 frame_counters[FrameCounter_COUNT];
+  // NOTE(lvl5): the part of State::query_cache_updates that belongs to the
+  // query, one slot per candidate so nothing is ever dropped
+  SatCacheUpdate *cache_updates;
+  u32 cache_update_count;
+  u32 cache_update_capacity;
 };
 
 struct State
 {
   u32 asteroids_per_wave;
-  u32 asteroid_count;
+  // NOTE(lvl5): from GameMemory, 0 for the normal game
+  u32 stress_asteroid_count;
   
   RenderGroup render_group;
   f32 screenshake_timer;
   
   ParticleSystem particle_system;
   
-  Entity entities[1024];
-  u32 entities_count;
+  // NOTE(lvl5): asteroids pick one of ASTEROID_SHAPE_COUNT shapes made at
+  // startup, starting at first_asteroid_shape
+  ShapePool shapes;
+  ShapeIndex bullet_shape;
+  ShapeIndex first_asteroid_shape;
+  
+  EntitySlots entity_slots;
+  Player player;
+  AsteroidArray asteroids;
+  BulletArray bullets;
+  
+  SatCache sat_cache;
+  u64 frame_counters[FrameCounter_COUNT];
+  
+  // NOTE(lvl5): from GameMemory, picks which of the three below is used
+  BroadphaseType broadphase;
+  
+  // NOTE(lvl5): only valid during the entity update, lives in transient_arena.
+  // Items are asteroid indices. Anything that sticks out of
+  // query_wrap_bounds can touch an asteroid on the other side of the world,
+  // see get_wrap_offsets. query_result has room for every asteroid, the grid
+  // and the tree put what they find there
+  SpatialGrid grid;
+  rect2 query_wrap_bounds;
+  u32 *query_result;
+  
+  // NOTE(lvl5): the asteroids, keyed by handle. Stays sorted between frames
+  // and grows in arena
+  SweepAndPrune sap;
+  
+  // NOTE(lvl5): the asteroids every query overlaps are found before the
+  // collision tests, query_pair_items[query_pair_first[id]] and on are the
+  // ones of query id, see get_query_id. query_cache_updates is indexed the
+  // same way, see CollisionQuery. Those live in transient_arena and are
+  // only valid during the entity update
+  u32 *query_pair_first;
+  u32 *query_pair_items;
+  SatCacheUpdate *query_cache_updates;
+  u32 query_id_count;
+  
+  // NOTE(lvl5): items are asteroid indices, kept up to date by
+  // flush_removed_asteroids. Lives in arena between frames
+  AabbTree tree;
   
   b32 initialized;
   
@@ -0,0 +1,1007 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "utils.h"
+
+/*
+uniform grid over the play area, rebuilt from scratch every frame. Every
+item is linked into all the cells its aabb overlaps; items outside the grid
+bounds are clamped into the border cells.
+Items are identified by the index the caller gives them.
+*/
+
+#define GRID_NULL U32_MAX
+
+struct GridNode
+{
+  u32 item_index;
+  u32 next;
+};
+
+struct GridCellRange
+{
+  u16 min_x;
+  u16 min_y;
+  u16 max_x;
+  u16 max_y;
+};
+
+struct SpatialGrid
+{
+  v2 origin;
+  f32 inv_cell_size;
+  u32 width;
+  u32 height;
+  
+  u32 *cell_first;
+  
+  GridNode *nodes;
+  u32 node_count;
+  u32 node_capacity;
+  
+  u32 *item_query_marks;
+  u32 item_capacity;
+  u32 query_mark;
+};
+
+void grid_begin(SpatialGrid *grid, rect2 bounds, f32 cell_size,
+                u32 item_capacity, u32 node_capacity)
+{
+  v2 size = get_size(bounds);
+  grid->origin = bounds.min;
+  grid->inv_cell_size = 1.0f/cell_size;
+  grid->width = (u32)ceilf(size.x*grid->inv_cell_size);
+  grid->height = (u32)ceilf(size.y*grid->inv_cell_size);
+  if (grid->width == 0) grid->width = 1;
+  if (grid->height == 0) grid->height = 1;
+  assert(grid->width <= U16_MAX && grid->height <= U16_MAX);
+  
+  u32 cell_count = grid->width*grid->height;
+  grid->cell_first = alloc_array(u32, cell_count);
+  for (u32 cell_index = 0; cell_index < cell_count; cell_index++)
+  {
+    grid->cell_first[cell_index] = GRID_NULL;
+  }
+  
+  grid->node_capacity = node_capacity;
+  grid->node_count = 0;
+  grid->nodes = alloc_array(GridNode, node_capacity);
+  
+  grid->item_capacity = item_capacity;
+  grid->item_query_marks = alloc_array(u32, item_capacity);
+  for (u32 item_index = 0; item_index < item_capacity; item_index++)
+  {
+    grid->item_query_marks[item_index] = 0;
+  }
+  grid->query_mark = 0;
+}
+
+i32 grid_clamp_cell(f32 cell, u32 count)
+{
+  i32 result = (i32)floorf(cell);
+  if (result < 0)
+  {
+    result = 0;
+  }
+  if (result > (i32)count - 1)
+  {
+    result = (i32)count - 1;
+  }
+  return result;
+}
+
+GridCellRange grid_cell_range(SpatialGrid *grid, rect2 aabb)
+{
+  v2 min = (aabb.min - grid->origin)*grid->inv_cell_size;
+  v2 max = (aabb.max - grid->origin)*grid->inv_cell_size;
+  
+  GridCellRange result;
+  result.min_x = (u16)grid_clamp_cell(min.x, grid->width);
+  result.min_y = (u16)grid_clamp_cell(min.y, grid->height);
+  result.max_x = (u16)grid_clamp_cell(max.x, grid->width);
+  result.max_y = (u16)grid_clamp_cell(max.y, grid->height);
+  return result;
+}
+
+void grid_insert(SpatialGrid *grid, u32 item_index, rect2 aabb)
+{
+  assert(item_index < grid->item_capacity);
+  GridCellRange range = grid_cell_range(grid, aabb);
+  
+  for (u32 y = range.min_y; y <= range.max_y; y++)
+  {
+    for (u32 x = range.min_x; x <= range.max_x; x++)
+    {
+      assert(grid->node_count < grid->node_capacity);
+      u32 node_index = grid->node_count++;
+      
+      u32 *first = grid->cell_first + y*grid->width + x;
+      GridNode *node = grid->nodes + node_index;
+      node->item_index = item_index;
+      node->next = *first;
+      *first = node_index;
+    }
+  }
+}
+
+// NOTE(lvl5): every item that shares a cell with the aabb, each reported once
+u32 grid_query(SpatialGrid *grid, rect2 aabb, u32 *result, u32 result_capacity)
+{
+  u32 result_count = 0;
+  GridCellRange range = grid_cell_range(grid, aabb);
+  
+  grid->query_mark++;
+  if (grid->query_mark == 0)
+  {
+    for (u32 item_index = 0; item_index < grid->item_capacity; item_index++)
+    {
+      grid->item_query_marks[item_index] = 0;
+    }
+    grid->query_mark = 1;
+  }
+  
+  for (u32 y = range.min_y; y <= range.max_y; y++)
+  {
+    for (u32 x = range.min_x; x <= range.max_x; x++)
+    {
+      u32 node_index = grid->cell_first[y*grid->width + x];
+      while (node_index != GRID_NULL)
+      {
+        GridNode *node = grid->nodes + node_index;
+        u32 *mark = grid->item_query_marks + node->item_index;
+        if (*mark != grid->query_mark)
+        {
+          *mark = grid->query_mark;
+          assert(result_count < result_capacity);
+          result[result_count++] = node->item_index;
+        }
+        node_index = node->next;
+      }
+    }
+  }
+  
+  return result_count;
+}
+
+/*
+sweep and prune on x. Items are kept sorted by min_x from one frame to the
+next. Things don't move far in a frame, so an insertion sort puts them back
+in order in about one pass.
+Queries are few and made fresh every frame. sap_find_pairs sweeps the items
+and the queries at once and writes every (query, item) pair whose aabbs
+overlap into one flat array. Items are never paired with each other.
+*/
+
+struct SapEntry
+{
+  rect2 aabb;
+  // NOTE(lvl5): key is what the caller knows the item by from frame to
+  // frame, index is what the pairs report
+  u32 key;
+  u32 index;
+};
+
+struct BroadphasePair
+{
+  u32 query_index;
+  u32 item_index;
+};
+
+struct SweepAndPrune
+{
+  SapEntry *items;
+  u32 item_count;
+  u32 item_capacity;
+  
+  // NOTE(lvl5): what the last sap_find_pairs found, see
+  // sap_guess_pair_capacity
+  u32 last_pair_count;
+};
+
+// NOTE(lvl5): the old items are left where they were, so only grow it
+// from an arena that gets thrown away as a whole
+void sap_reserve(SweepAndPrune *sap, u32 capacity)
+{
+  if (capacity <= sap->item_capacity)
+  {
+    return;
+  }
+  
+  u32 new_capacity = sap->item_capacity*2;
+  if (new_capacity < capacity)
+  {
+    new_capacity = capacity;
+  }
+  SapEntry *items = alloc_array(SapEntry, new_capacity);
+  copy_memory(items, sap->items, sap->item_count*sizeof(SapEntry));
+  sap->items = items;
+  sap->item_capacity = new_capacity;
+}
+
+// NOTE(lvl5): flips the bits of a float so they sort like the float does
+u32 get_sap_sort_key(f32 x)
+{
+  u32 bits;
+  copy_memory(&bits, &x, sizeof(bits));
+  u32 result = (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+  return result;
+}
+
+// NOTE(lvl5): radix sort on min_x, a byte at a time
+void sap_radix_sort_entries(SapEntry *entries, u32 count)
+{
+  u32 counts[4][256] = {};
+  for (u32 entry_index = 0; entry_index < count; entry_index++)
+  {
+    u32 key = get_sap_sort_key(entries[entry_index].aabb.min.x);
+    for (u32 byte_index = 0; byte_index < 4; byte_index++)
+    {
+      counts[byte_index][(key >> (byte_index*8)) & 0xFF]++;
+    }
+  }
+  
+  SapEntry *scratch = alloc_array(SapEntry, count);
+  SapEntry *from = entries;
+  SapEntry *to = scratch;
+  for (u32 byte_index = 0; byte_index < 4; byte_index++)
+  {
+    u32 first[256];
+    u32 total = 0;
+    for (u32 digit = 0; digit < 256; digit++)
+    {
+      first[digit] = total;
+      total += counts[byte_index][digit];
+    }
+    
+    for (u32 entry_index = 0; entry_index < count; entry_index++)
+    {
+      u32 key = get_sap_sort_key(from[entry_index].aabb.min.x);
+      to[first[(key >> (byte_index*8)) & 0xFF]++] = from[entry_index];
+    }
+    swap(from, to);
+  }
+}
+
+// NOTE(lvl5): insertion sort on min_x, returns how many places things
+// moved, which is about how much the order changed since last time. When
+// that goes past SAP_SORT_MOVE_BUDGET per entry, like right after a lot of
+// things spawned in one spot and flew apart, or when they are packed so
+// tight that they pass each other all the time, it radix sorts instead
+#define SAP_SORT_MOVE_BUDGET 4
+
+u32 sap_sort_entries(SapEntry *entries, u32 count)
+{
+  u32 result = 0;
+  u64 move_budget = (u64)count*SAP_SORT_MOVE_BUDGET;
+  for (u32 entry_index = 1; entry_index < count; entry_index++)
+  {
+    if (result > move_budget)
+    {
+      sap_radix_sort_entries(entries, count);
+      break;
+    }
+    
+    SapEntry entry = entries[entry_index];
+    u32 insert_index = entry_index;
+    while (insert_index > 0 &&
+           entries[insert_index - 1].aabb.min.x > entry.aabb.min.x)
+    {
+      entries[insert_index] = entries[insert_index - 1];
+      insert_index--;
+    }
+    entries[insert_index] = entry;
+    result += entry_index - insert_index;
+  }
+  return result;
+}
+
+// NOTE(lvl5): puts sap->items back in order and merges entries in. Those
+// are the items that are new, or moved too far since last frame for the
+// insertion sort to be cheap, like ones that wrapped around the world.
+// sap needs room for them. Returns what sap_sort_entries did
+u32 sap_sort(SweepAndPrune *sap, SapEntry *entries, u32 entry_count)
+{
+  assert(sap->item_count + entry_count <= sap->item_capacity);
+  u32 result = sap_sort_entries(sap->items, sap->item_count);
+  sap_radix_sort_entries(entries, entry_count);
+  
+  // NOTE(lvl5): from the back, so the items can be merged where they are
+  u32 item_index = sap->item_count;
+  u32 entry_index = entry_count;
+  u32 to_index = sap->item_count + entry_count;
+  while (entry_index > 0)
+  {
+    if (item_index > 0 &&
+        sap->items[item_index - 1].aabb.min.x > entries[entry_index - 1].aabb.min.x)
+    {
+      sap->items[--to_index] = sap->items[--item_index];
+    }
+    else
+    {
+      sap->items[--to_index] = entries[--entry_index];
+    }
+  }
+  sap->item_count += entry_count;
+  return result;
+}
+
+b32 sap_overlap_y(SapEntry *a, SapEntry *b)
+{
+  b32 result = a->aabb.min.y <= b->aabb.max.y && b->aabb.min.y <= a->aabb.max.y;
+  return result;
+}
+
+// NOTE(lvl5): the pairs don't change much from frame to frame either
+u32 guess_pair_capacity(u32 last_pair_count, u32 query_count)
+{
+  u32 result = last_pair_count + last_pair_count/4 + query_count*2 + 64;
+  return result;
+}
+
+u32 sap_guess_pair_capacity(SweepAndPrune *sap, u32 query_count)
+{
+  u32 result = guess_pair_capacity(sap->last_pair_count, query_count);
+  return result;
+}
+
+// NOTE(lvl5): sap->items have to be sorted, queries get sorted here.
+// Returns how many pairs there are, which can be more than pair_capacity,
+// then only the first pair_capacity are written and the caller should try
+// again with more room
+u32 sap_find_pairs(SweepAndPrune *sap, SapEntry *queries, u32 query_count,
+                   BroadphasePair *pairs, u32 pair_capacity)
+{
+  sap_sort_entries(queries, query_count);
+  
+  u32 result = 0;
+  // NOTE(lvl5): copies, so the scans run through memory in order
+  SapEntry *active_items = alloc_array(SapEntry, sap->item_count + 1);
+  u32 active_item_count = 0;
+  SapEntry *active_queries = alloc_array(SapEntry, query_count + 1);
+  u32 active_query_count = 0;
+  
+  u32 item_index = 0;
+  u32 query_index = 0;
+  while (query_index < query_count || active_query_count)
+  {
+    b32 next_is_item = item_index < sap->item_count &&
+      (query_index == query_count ||
+       sap->items[item_index].aabb.min.x < queries[query_index].aabb.min.x);
+    if (next_is_item)
+    {
+      SapEntry *item = sap->items + item_index;
+      for (u32 active_index = 0; active_index < active_query_count;)
+      {
+        SapEntry *query = active_queries + active_index;
+        if (query->aabb.max.x < item->aabb.min.x)
+        {
+          active_queries[active_index] = active_queries[--active_query_count];
+          continue;
+        }
+        if (sap_overlap_y(query, item))
+        {
+          if (result < pair_capacity)
+          {
+            pairs[result].query_index = query->index;
+            pairs[result].item_index = item->index;
+          }
+          result++;
+        }
+        active_index++;
+      }
+      
+      // NOTE(lvl5): only queries that start later need to see it
+      if (query_index < query_count)
+      {
+        active_items[active_item_count++] = *item;
+      }
+      item_index++;
+    }
+    else if (query_index < query_count)
+    {
+      SapEntry *query = queries + query_index;
+      for (u32 active_index = 0; active_index < active_item_count;)
+      {
+        SapEntry *item = active_items + active_index;
+        if (item->aabb.max.x < query->aabb.min.x)
+        {
+          active_items[active_index] = active_items[--active_item_count];
+          continue;
+        }
+        if (sap_overlap_y(query, item))
+        {
+          if (result < pair_capacity)
+          {
+            pairs[result].query_index = query->index;
+            pairs[result].item_index = item->index;
+          }
+          result++;
+        }
+        active_index++;
+      }
+      
+      active_queries[active_query_count++] = *query;
+      query_index++;
+    }
+    else
+    {
+      // NOTE(lvl5): out of items, the active queries can't meet anything
+      break;
+    }
+  }
+  
+  sap->last_pair_count = result;
+  return result;
+}
+
+/*
+dynamic aabb tree. Every item is a leaf with a fattened aabb, internal nodes
+bound their two children. An item only goes back into the tree when its aabb
+leaves the fat one, so things that drift a little cost nothing. New leaves
+go next to the sibling that makes the tree grow the least, and the way back
+up rotates nodes so neither side of any node gets more than one level
+deeper than the other.
+Unlike the grid it doesn't care how big things are or how far apart, so
+items from tiny to world sized mix fine.
+Nodes are identified by index, the one an item got from aabb_tree_insert is
+its proxy and stays the same until it is removed.
+*/
+
+#define AABB_TREE_NULL U32_MAX
+// NOTE(lvl5): how much bigger than the item a leaf is on every side, and how
+// many frames of motion ahead it reaches
+#define AABB_TREE_MARGIN 0.25f
+#define AABB_TREE_DISPLACEMENT_MULTIPLIER 4.0f
+#define AABB_TREE_MAX_DEPTH 256
+
+struct AabbTreeNode
+{
+  rect2 aabb;
+  // NOTE(lvl5): the next free node while on the free list
+  u32 parent;
+  u32 child_a;
+  u32 child_b;
+  u32 item_index;
+  // NOTE(lvl5): 0 for leaves, -1 for free nodes
+  i32 height;
+};
+
+struct AabbTree
+{
+  AabbTreeNode *nodes;
+  u32 node_count;
+  u32 node_capacity;
+  u32 free_node;
+  u32 root;
+  
+  // NOTE(lvl5): what the last aabb_tree_find_pairs found, see
+  // aabb_tree_guess_pair_capacity
+  u32 last_pair_count;
+};
+
+b32 aabb_tree_is_leaf(AabbTreeNode *node)
+{
+  b32 result = node->child_a == AABB_TREE_NULL;
+  return result;
+}
+
+rect2 get_union(rect2 a, rect2 b)
+{
+  rect2 result;
+  result.min.x = a.min.x < b.min.x ? a.min.x : b.min.x;
+  result.min.y = a.min.y < b.min.y ? a.min.y : b.min.y;
+  result.max.x = a.max.x > b.max.x ? a.max.x : b.max.x;
+  result.max.y = a.max.y > b.max.y ? a.max.y : b.max.y;
+  return result;
+}
+
+f32 get_perimeter(rect2 r)
+{
+  v2 size = get_size(r);
+  f32 result = 2*(size.x + size.y);
+  return result;
+}
+
+b32 contains(rect2 outer, rect2 inner)
+{
+  b32 result = outer.min.x <= inner.min.x && outer.min.y <= inner.min.y &&
+    inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+  return result;
+}
+
+void aabb_tree_init(AabbTree *tree)
+{
+  *tree = {};
+  tree->free_node = AABB_TREE_NULL;
+  tree->root = AABB_TREE_NULL;
+}
+
+// NOTE(lvl5): the node array grows like SweepAndPrune::items, so only from
+// an arena that gets thrown away as a whole
+u32 aabb_tree_alloc_node(AabbTree *tree)
+{
+  if (tree->free_node == AABB_TREE_NULL)
+  {
+    if (tree->node_count == tree->node_capacity)
+    {
+      u32 new_capacity = tree->node_capacity ? tree->node_capacity*2 : 256;
+      AabbTreeNode *nodes = alloc_array(AabbTreeNode, new_capacity);
+      copy_memory(nodes, tree->nodes, tree->node_count*sizeof(AabbTreeNode));
+      tree->nodes = nodes;
+      tree->node_capacity = new_capacity;
+    }
+    tree->nodes[tree->node_count].parent = AABB_TREE_NULL;
+    tree->free_node = tree->node_count++;
+  }
+  
+  u32 result = tree->free_node;
+  AabbTreeNode *node = tree->nodes + result;
+  tree->free_node = node->parent;
+  node->parent = AABB_TREE_NULL;
+  node->child_a = AABB_TREE_NULL;
+  node->child_b = AABB_TREE_NULL;
+  node->item_index = AABB_TREE_NULL;
+  node->height = 0;
+  return result;
+}
+
+void aabb_tree_free_node(AabbTree *tree, u32 node_index)
+{
+  AabbTreeNode *node = tree->nodes + node_index;
+  node->parent = tree->free_node;
+  node->height = -1;
+  tree->free_node = node_index;
+}
+
+void aabb_tree_fix_node(AabbTree *tree, u32 node_index)
+{
+  AabbTreeNode *node = tree->nodes + node_index;
+  AabbTreeNode *a = tree->nodes + node->child_a;
+  AabbTreeNode *b = tree->nodes + node->child_b;
+  node->aabb = get_union(a->aabb, b->aabb);
+  node->height = 1 + (a->height > b->height ? a->height : b->height);
+}
+
+// NOTE(lvl5): when one child of a is more than a level taller than the
+// other, the taller one takes a's place and a takes one of its children.
+// Returns the node that is now where a was
+u32 aabb_tree_balance(AabbTree *tree, u32 a_index)
+{
+  AabbTreeNode *a = tree->nodes + a_index;
+  if (aabb_tree_is_leaf(a) || a->height < 2)
+  {
+    return a_index;
+  }
+  
+  u32 b_index = a->child_a;
+  u32 c_index = a->child_b;
+  AabbTreeNode *b = tree->nodes + b_index;
+  AabbTreeNode *c = tree->nodes + c_index;
+  i32 balance = c->height - b->height;
+  if (balance >= -1 && balance <= 1)
+  {
+    return a_index;
+  }
+  
+  // NOTE(lvl5): rise is the taller child, stay the other one
+  u32 rise_index = balance > 1 ? c_index : b_index;
+  AabbTreeNode *rise = tree->nodes + rise_index;
+  u32 f_index = rise->child_a;
+  u32 g_index = rise->child_b;
+  AabbTreeNode *f = tree->nodes + f_index;
+  AabbTreeNode *g = tree->nodes + g_index;
+  
+  rise->child_a = a_index;
+  rise->parent = a->parent;
+  a->parent = rise_index;
+  if (rise->parent == AABB_TREE_NULL)
+  {
+    tree->root = rise_index;
+  }
+  else
+  {
+    AabbTreeNode *parent = tree->nodes + rise->parent;
+    if (parent->child_a == a_index)
+    {
+      parent->child_a = rise_index;
+    }
+    else
+    {
+      parent->child_b = rise_index;
+    }
+  }
+  
+  // NOTE(lvl5): the taller grandchild stays under rise, the other one goes
+  // where rise was under a
+  u32 keep_index = f->height > g->height ? f_index : g_index;
+  u32 move_index = f->height > g->height ? g_index : f_index;
+  rise->child_b = keep_index;
+  if (rise_index == c_index)
+  {
+    a->child_b = move_index;
+  }
+  else
+  {
+    a->child_a = move_index;
+  }
+  tree->nodes[move_index].parent = a_index;
+  
+  aabb_tree_fix_node(tree, a_index);
+  aabb_tree_fix_node(tree, rise_index);
+  return rise_index;
+}
+
+void aabb_tree_insert_leaf(AabbTree *tree, u32 leaf_index)
+{
+  if (tree->root == AABB_TREE_NULL)
+  {
+    tree->root = leaf_index;
+    tree->nodes[leaf_index].parent = AABB_TREE_NULL;
+    return;
+  }
+  
+  // NOTE(lvl5): walk down to where the leaf costs the least extra
+  // perimeter, counting what it adds to every node on the way
+  rect2 leaf_aabb = tree->nodes[leaf_index].aabb;
+  u32 sibling_index = tree->root;
+  while (!aabb_tree_is_leaf(tree->nodes + sibling_index))
+  {
+    AabbTreeNode *node = tree->nodes + sibling_index;
+    f32 perimeter = get_perimeter(node->aabb);
+    f32 combined_perimeter = get_perimeter(get_union(node->aabb, leaf_aabb));
+    
+    // NOTE(lvl5): a new parent for this node and the leaf, and what pushing
+    // the leaf further down costs every node from here on
+    f32 cost = 2*combined_perimeter;
+    f32 inheritance_cost = 2*(combined_perimeter - perimeter);
+    
+    f32 child_costs[2];
+    u32 children[2] = {node->child_a, node->child_b};
+    for (u32 child_slot = 0; child_slot < 2; child_slot++)
+    {
+      AabbTreeNode *child = tree->nodes + children[child_slot];
+      f32 child_perimeter = get_perimeter(get_union(leaf_aabb, child->aabb));
+      if (!aabb_tree_is_leaf(child))
+      {
+        child_perimeter -= get_perimeter(child->aabb);
+      }
+      child_costs[child_slot] = child_perimeter + inheritance_cost;
+    }
+    
+    if (cost < child_costs[0] && cost < child_costs[1])
+    {
+      break;
+    }
+    sibling_index = child_costs[0] < child_costs[1] ? children[0] : children[1];
+  }
+  
+  u32 old_parent_index = tree->nodes[sibling_index].parent;
+  u32 new_parent_index = aabb_tree_alloc_node(tree);
+  AabbTreeNode *new_parent = tree->nodes + new_parent_index;
+  AabbTreeNode *sibling = tree->nodes + sibling_index;
+  new_parent->parent = old_parent_index;
+  new_parent->child_a = sibling_index;
+  new_parent->child_b = leaf_index;
+  sibling->parent = new_parent_index;
+  tree->nodes[leaf_index].parent = new_parent_index;
+  
+  if (old_parent_index == AABB_TREE_NULL)
+  {
+    tree->root = new_parent_index;
+  }
+  else
+  {
+    AabbTreeNode *old_parent = tree->nodes + old_parent_index;
+    if (old_parent->child_a == sibling_index)
+    {
+      old_parent->child_a = new_parent_index;
+    }
+    else
+    {
+      old_parent->child_b = new_parent_index;
+    }
+  }
+  
+  for (u32 node_index = new_parent_index;
+       node_index != AABB_TREE_NULL;
+       node_index = tree->nodes[node_index].parent)
+  {
+    node_index = aabb_tree_balance(tree, node_index);
+    aabb_tree_fix_node(tree, node_index);
+  }
+}
+
+void aabb_tree_remove_leaf(AabbTree *tree, u32 leaf_index)
+{
+  if (leaf_index == tree->root)
+  {
+    tree->root = AABB_TREE_NULL;
+    return;
+  }
+  
+  u32 parent_index = tree->nodes[leaf_index].parent;
+  AabbTreeNode *parent = tree->nodes + parent_index;
+  u32 grand_parent_index = parent->parent;
+  u32 sibling_index = parent->child_a == leaf_index ? parent->child_b : parent->child_a;
+  
+  tree->nodes[sibling_index].parent = grand_parent_index;
+  if (grand_parent_index == AABB_TREE_NULL)
+  {
+    tree->root = sibling_index;
+  }
+  else
+  {
+    AabbTreeNode *grand_parent = tree->nodes + grand_parent_index;
+    if (grand_parent->child_a == parent_index)
+    {
+      grand_parent->child_a = sibling_index;
+    }
+    else
+    {
+      grand_parent->child_b = sibling_index;
+    }
+  }
+  aabb_tree_free_node(tree, parent_index);
+  
+  for (u32 node_index = grand_parent_index;
+       node_index != AABB_TREE_NULL;
+       node_index = tree->nodes[node_index].parent)
+  {
+    node_index = aabb_tree_balance(tree, node_index);
+    aabb_tree_fix_node(tree, node_index);
+  }
+}
+
+rect2 get_fat_aabb(rect2 aabb, v2 displacement)
+{
+  rect2 result = resize_centered(aabb, v2(2, 2)*AABB_TREE_MARGIN);
+  v2 d = displacement*AABB_TREE_DISPLACEMENT_MULTIPLIER;
+  if (d.x > 0) result.max.x += d.x; else result.min.x += d.x;
+  if (d.y > 0) result.max.y += d.y; else result.min.y += d.y;
+  return result;
+}
+
+// NOTE(lvl5): returns the proxy of the item
+u32 aabb_tree_insert(AabbTree *tree, rect2 aabb, u32 item_index)
+{
+  u32 result = aabb_tree_alloc_node(tree);
+  AabbTreeNode *leaf = tree->nodes + result;
+  leaf->aabb = get_fat_aabb(aabb, v2());
+  leaf->item_index = item_index;
+  aabb_tree_insert_leaf(tree, result);
+  return result;
+}
+
+void aabb_tree_remove(AabbTree *tree, u32 proxy)
+{
+  assert(proxy < tree->node_count && aabb_tree_is_leaf(tree->nodes + proxy));
+  aabb_tree_remove_leaf(tree, proxy);
+  aabb_tree_free_node(tree, proxy);
+}
+
+// NOTE(lvl5): for when the caller renumbers its items
+void aabb_tree_set_item(AabbTree *tree, u32 proxy, u32 item_index)
+{
+  assert(proxy < tree->node_count && aabb_tree_is_leaf(tree->nodes + proxy));
+  tree->nodes[proxy].item_index = item_index;
+}
+
+// NOTE(lvl5): displacement is how far the item moved since last time, the
+// new leaf reaches further that way. Leaves that got much too big for the
+// item are shrunk again. Returns whether the item went back into the tree
+b32 aabb_tree_move(AabbTree *tree, u32 proxy, rect2 aabb, v2 displacement)
+{
+  assert(proxy < tree->node_count && aabb_tree_is_leaf(tree->nodes + proxy));
+  AabbTreeNode *leaf = tree->nodes + proxy;
+  if (contains(leaf->aabb, aabb))
+  {
+    rect2 huge_aabb = get_fat_aabb(resize_centered(aabb, v2(6, 6)*AABB_TREE_MARGIN),
+                                   displacement*4);
+    if (contains(huge_aabb, leaf->aabb))
+    {
+      return false;
+    }
+  }
+  
+  aabb_tree_remove_leaf(tree, proxy);
+  leaf->aabb = get_fat_aabb(aabb, displacement);
+  aabb_tree_insert_leaf(tree, proxy);
+  return true;
+}
+
+// NOTE(lvl5): every item whose leaf overlaps aabb, each reported once
+u32 aabb_tree_query(AabbTree *tree, rect2 aabb, u32 *result, u32 result_capacity)
+{
+  u32 result_count = 0;
+  if (tree->root == AABB_TREE_NULL)
+  {
+    return result_count;
+  }
+  
+  u32 stack[AABB_TREE_MAX_DEPTH];
+  u32 stack_count = 0;
+  stack[stack_count++] = tree->root;
+  while (stack_count)
+  {
+    AabbTreeNode *node = tree->nodes + stack[--stack_count];
+    if (!intersects(node->aabb, aabb))
+    {
+      continue;
+    }
+    
+    if (aabb_tree_is_leaf(node))
+    {
+      assert(result_count < result_capacity);
+      result[result_count++] = node->item_index;
+    }
+    else
+    {
+      assert(stack_count + 2 <= AABB_TREE_MAX_DEPTH);
+      stack[stack_count++] = node->child_a;
+      stack[stack_count++] = node->child_b;
+    }
+  }
+  return result_count;
+}
+
+// NOTE(lvl5): slab test of the segment from start to start + d_p against
+// aabb grown by extents on every side, which is the same as sweeping a box
+// of half size extents along it
+b32 segment_overlaps_aabb(v2 start, v2 d_p, v2 extents, rect2 aabb)
+{
+  rect2 grown = rect2(aabb.min - extents, aabb.max + extents);
+  f32 t_min = 0;
+  f32 t_max = 1;
+  for (u32 axis = 0; axis < 2; axis++)
+  {
+    f32 p = axis ? start.y : start.x;
+    f32 d = axis ? d_p.y : d_p.x;
+    f32 min = axis ? grown.min.y : grown.min.x;
+    f32 max = axis ? grown.max.y : grown.max.x;
+    if (d == 0)
+    {
+      if (p < min || p > max)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      f32 t_enter = (min - p)/d;
+      f32 t_exit = (max - p)/d;
+      if (t_enter > t_exit)
+      {
+        swap(t_enter, t_exit);
+      }
+      if (t_enter > t_min) t_min = t_enter;
+      if (t_exit < t_max) t_max = t_exit;
+      if (t_min > t_max)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// NOTE(lvl5): every item whose leaf a box of half size extents touches on
+// its way from start to start + d_p. Much tighter than an aabb around the
+// whole way when it goes diagonally
+u32 aabb_tree_query_segment(AabbTree *tree, v2 start, v2 d_p, v2 extents,
+                            u32 *result, u32 result_capacity)
+{
+  u32 result_count = 0;
+  if (tree->root == AABB_TREE_NULL)
+  {
+    return result_count;
+  }
+  
+  u32 stack[AABB_TREE_MAX_DEPTH];
+  u32 stack_count = 0;
+  stack[stack_count++] = tree->root;
+  while (stack_count)
+  {
+    AabbTreeNode *node = tree->nodes + stack[--stack_count];
+    if (!segment_overlaps_aabb(start, d_p, extents, node->aabb))
+    {
+      continue;
+    }
+    
+    if (aabb_tree_is_leaf(node))
+    {
+      assert(result_count < result_capacity);
+      result[result_count++] = node->item_index;
+    }
+    else
+    {
+      assert(stack_count + 2 <= AABB_TREE_MAX_DEPTH);
+      stack[stack_count++] = node->child_a;
+      stack[stack_count++] = node->child_b;
+    }
+  }
+  return result_count;
+}
+
+u32 aabb_tree_guess_pair_capacity(AabbTree *tree, u32 query_count)
+{
+  u32 result = guess_pair_capacity(tree->last_pair_count, query_count);
+  return result;
+}
+
+// NOTE(lvl5): like sap_find_pairs, the pairs of query_aabbs[i] report
+// query_index i. Counts past pair_capacity without writing them
+u32 aabb_tree_find_pairs(AabbTree *tree, rect2 *query_aabbs, u32 query_count,
+                         BroadphasePair *pairs, u32 pair_capacity)
+{
+  u32 result = 0;
+  tree->last_pair_count = 0;
+  if (tree->root == AABB_TREE_NULL)
+  {
+    return result;
+  }
+  
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    rect2 aabb = query_aabbs[query_index];
+    u32 stack[AABB_TREE_MAX_DEPTH];
+    u32 stack_count = 0;
+    stack[stack_count++] = tree->root;
+    while (stack_count)
+    {
+      AabbTreeNode *node = tree->nodes + stack[--stack_count];
+      if (!intersects(node->aabb, aabb))
+      {
+        continue;
+      }
+      
+      if (aabb_tree_is_leaf(node))
+      {
+        if (result < pair_capacity)
+        {
+          pairs[result].query_index = query_index;
+          pairs[result].item_index = node->item_index;
+        }
+        result++;
+      }
+      else
+      {
+        assert(stack_count + 2 <= AABB_TREE_MAX_DEPTH);
+        stack[stack_count++] = node->child_a;
+        stack[stack_count++] = node->child_b;
+      }
+    }
+  }
+  tree->last_pair_count = result;
+  return result;
+}
+
+// NOTE(lvl5): walks the whole tree and checks the links, heights and
+// bounds. Returns the number of leaves
+u32 aabb_tree_validate(AabbTree *tree, u32 node_index, u32 parent_index)
+{
+  if (node_index == AABB_TREE_NULL)
+  {
+    return 0;
+  }
+  
+  AabbTreeNode *node = tree->nodes + node_index;
+  assert(node->parent == parent_index);
+  if (aabb_tree_is_leaf(node))
+  {
+    assert(node->height == 0);
+    return 1;
+  }
+  
+  AabbTreeNode *a = tree->nodes + node->child_a;
+  AabbTreeNode *b = tree->nodes + node->child_b;
+  i32 balance = a->height - b->height;
+  assert(balance >= -1 && balance <= 1);
+  assert(node->height == 1 + (a->height > b->height ? a->height : b->height));
+  assert(contains(node->aabb, a->aabb) && contains(node->aabb, b->aabb));
+  
+  u32 result = aabb_tree_validate(tree, node->child_a, node_index) +
+    aabb_tree_validate(tree, node->child_b, node_index);
+  return result;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "platform.h"
+#include "asteroids.cpp"
+#include "linux_platform.cpp"
+
+/*
+runs game_update for a fixed number of frames with a fixed delta_time and
+reports how long every FramePhase took. The game seeds its RandomSequences
+with constants on init and the input is scripted or generated from a fixed
+seed, so every run simulates the same world.
+*/
+
+int compare_u64(const void *a, const void *b)
+{
+  u64 a_value = *(u64 *)a;
+  u64 b_value = *(u64 *)b;
+  int result = a_value < b_value ? -1 : (a_value > b_value ? 1 : 0);
+  return result;
+}
+
+void print_samples(char *name, u64 *samples, u32 count)
+{
+  u64 total = 0;
+  for (u32 sample_index = 0; sample_index < count; sample_index++)
+  {
+    total += samples[sample_index];
+  }
+  
+  qsort(samples, count, sizeof(u64), compare_u64);
+  
+  u64 min = samples[0];
+  u64 median = samples[count/2];
+  u64 p99 = samples[(u32)((u64)count*99/100)];
+  
+  printf("%-16s %12llu %12llu %12llu %12llu\n", name,
+         total/count, min, median, p99);
+}
+
+int main(int argc, char **argv)
+{
+  linux_init_default_context();
+  
+  LinuxOptions options = {};
+  options.frame_count = 10000;
+  options.warmup_frame_count = 100;
+  options.delta_time = 1.0f/60.0f;
+  options.thread_count = -1;
+  if (!linux_parse_options(&options, argc, argv))
+  {
+    return 1;
+  }
+  if (options.frame_count == 0)
+  {
+    fprintf(stderr, "nothing to measure\n");
+    return 1;
+  }
+  
+  InputScript script;
+  if (!linux_init_input_script(&script, options.script_file_name))
+  {
+    return 1;
+  }
+  
+  gl_load_functions();
+  
+  
+  GameMemory game_memory = linux_init_game_memory(&options);
+  
+  GameInput game_input = {};
+  game_input.delta_time = options.delta_time;
+  
+  GameScreen game_screen;
+  game_screen.size.x = 800;
+  game_screen.size.y = 600;
+  
+  u32 frame_count = options.frame_count;
+  u64 *frame_samples = alloc_array(u64, frame_count);
+  u64 *phase_samples[FramePhase_COUNT];
+  for (u32 phase_index = 0; phase_index < FramePhase_COUNT; phase_index++)
+  {
+    phase_samples[phase_index] = alloc_array(u64, frame_count);
+  }
+  u64 counter_totals[FrameCounter_COUNT] = {};
+  
+  for (u32 frame_index = 0; frame_index < options.warmup_frame_count; frame_index++)
+  {
+    update_scripted_input(&script, &game_input);
+    game_update(&game_memory, &game_input, &game_screen);
+    reset_temp_storage();
+  }
+  
+  for (u32 frame_index = 0; frame_index < frame_count; frame_index++)
+  {
+    update_scripted_input(&script, &game_input);
+    
+    u64 frame_start = platform_get_nanoseconds();
+    game_update(&game_memory, &game_input, &game_screen);
+    frame_samples[frame_index] = platform_get_nanoseconds() - frame_start;
+    
+    for (u32 phase_index = 0; phase_index < FramePhase_COUNT; phase_index++)
+    {
+      phase_samples[phase_index][frame_index] =
+        game_memory.phase_nanoseconds[phase_index];
+    }
+    for (u32 counter_index = 0; counter_index < FrameCounter_COUNT; counter_index++)
+    {
+      counter_totals[counter_index] += game_memory.frame_counters[counter_index];
+    }
+    
+    reset_temp_storage();
+  }
+  
+  char *phase_names[FramePhase_COUNT] = {
+    "particles",
+    "movement/wrap",
+    "entity update",
+    "render",
+  };
+  
+  printf("frames: %u, warmup: %u, dt: %f\n", frame_count,
+         options.warmup_frame_count, options.delta_time);
+  printf("%-16s %12s %12s %12s %12s\n", "phase (ns)", "mean", "min", "median", "p99");
+  for (u32 phase_index = 0; phase_index < FramePhase_COUNT; phase_index++)
+  {
+    print_samples(phase_names[phase_index], phase_samples[phase_index], frame_count);
+  }
+  print_samples("frame", frame_samples, frame_count);
+  
+  u64 sat_pair_count = counter_totals[FrameCounter_SAT_PAIRS];
+  u64 lookup_count = counter_totals[FrameCounter_SAT_CACHE_LOOKUPS];
+  u64 hit_count = counter_totals[FrameCounter_SAT_CACHE_HITS];
+  printf("sat pairs/frame: %.2f, axes/frame: %.2f, axes/pair: %.2f\n",
+         (f64)sat_pair_count/frame_count,
+         (f64)counter_totals[FrameCounter_SAT_AXES]/frame_count,
+         sat_pair_count ? (f64)counter_totals[FrameCounter_SAT_AXES]/sat_pair_count : 0.0);
+  printf("sat cache: %llu lookups, %llu hits, %.1f%% of pairs, %.1f%% of lookups\n",
+         lookup_count, hit_count,
+         sat_pair_count ? 100.0*hit_count/sat_pair_count : 0.0,
+         lookup_count ? 100.0*hit_count/lookup_count : 0.0);
+  
+  pop_context();
+  return 0;
+}
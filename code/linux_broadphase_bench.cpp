@@ -0,0 +1,572 @@
+#include "platform.h"
+#include "asteroids.cpp"
+#include "linux_platform.cpp"
+
+/*
+brute force, the grid, the sweep and prune and the aabb tree finding which
+items a set of small moving boxes (the queries, like bullets) overlap, over a
+number of frames of motion, for four ways of spreading the items:
+- uniform: all over the world
+- clustered: in a few tight clumps
+- explosion: everything starts in one spot and flies outwards, so the order
+  on x changes a lot from frame to frame
+- mixed: all over the world, from pebbles to things half the world across
+The grid is rebuilt every frame like the game does, the sweep and prune keeps
+its items sorted from the frame before and the tree moves the leaves that
+need it. The world doesn't wrap here.
+All of them have to find the same pairs every frame, the grid and tree
+candidates are cut down to the ones whose aabbs overlap first.
+The same goes for the boxes swept along the way the queries moved, done by
+brute force and with the tree (seg/bf and seg/tr).
+usage: linux_broadphase_bench [-items n] [-queries n] [-frames n]
+*/
+
+enum Distribution
+{
+  Distribution_UNIFORM,
+  Distribution_CLUSTERED,
+  Distribution_EXPLOSION,
+  Distribution_MIXED,
+  
+  Distribution_COUNT,
+};
+
+struct BenchBody
+{
+  v2 p;
+  v2 velocity;
+  v2 half_size;
+};
+
+struct PairSet
+{
+  u64 count;
+  u64 checksum;
+  u64 candidate_count;
+};
+
+struct MethodStats
+{
+  u64 nanoseconds;
+  u64 pair_count;
+  u64 candidate_count;
+};
+
+#define BENCH_CLUSTER_COUNT 8
+
+void push_bench_arena_context(Arena *arena)
+{
+  LocalContext ctx = make_context(get_local_context());
+  ctx.allocator = arena_allocator;
+  ctx.allocator_data = arena;
+  push_context(ctx);
+}
+
+void add_to_pair_set(PairSet *set, u32 query_index, u32 item_index)
+{
+  // NOTE(lvl5): a sum, so the order the pairs come in doesn't matter
+  u64 pair = ((u64)query_index << 32) | item_index;
+  set->count++;
+  set->checksum += pair*0x9E3779B97F4A7C15ULL ^ (pair >> 17);
+}
+
+rect2 get_body_aabb(BenchBody *body)
+{
+  rect2 result = rect2(body->p - body->half_size, body->p + body->half_size);
+  return result;
+}
+
+// NOTE(lvl5): swept over the frame it just moved through, like
+// get_swept_query_aabb
+rect2 get_query_aabb(BenchBody *body, f32 dt)
+{
+  rect2 result = get_body_aabb(body);
+  v2 d_p = body->velocity*dt;
+  if (d_p.x > 0) result.min.x -= d_p.x; else result.max.x -= d_p.x;
+  if (d_p.y > 0) result.min.y -= d_p.y; else result.max.y -= d_p.y;
+  return result;
+}
+
+void generate_items(RandomSequence *rand, Distribution distribution, v2 area,
+                    BenchBody *items, u32 item_count)
+{
+  v2 cluster_centers[BENCH_CLUSTER_COUNT];
+  for (u32 cluster_index = 0; cluster_index < BENCH_CLUSTER_COUNT; cluster_index++)
+  {
+    cluster_centers[cluster_index] =
+      hadamard(v2(random_bilateral(rand), random_bilateral(rand)), area*0.4f);
+  }
+  
+  for (u32 item_index = 0; item_index < item_count; item_index++)
+  {
+    BenchBody *item = items + item_index;
+    f32 scale = random_range(rand, 0.5f, 2.5f);
+    item->half_size = v2(scale, scale)*0.5f;
+    item->velocity = v2(random_bilateral(rand), random_bilateral(rand))*4/scale;
+    
+    switch (distribution)
+    {
+      case Distribution_UNIFORM:
+      {
+        item->p = hadamard(v2(random_bilateral(rand), random_bilateral(rand)), area*0.5f);
+      } break;
+      
+      case Distribution_CLUSTERED:
+      {
+        u32 cluster_index = (u32)random_range_i32(rand, 0, BENCH_CLUSTER_COUNT - 1);
+        item->p = cluster_centers[cluster_index] +
+          v2(random_bilateral(rand), random_bilateral(rand));
+      } break;
+      
+      case Distribution_EXPLOSION:
+      {
+        item->p = v2(random_bilateral(rand), random_bilateral(rand))*0.1f;
+        f32 angle = random_range(rand, 0, 2*PI);
+        item->velocity = rotate(v2(random_range(rand, 2.0f, 12.0f), 0.0f), angle);
+      } break;
+      
+      case Distribution_MIXED:
+      {
+        // NOTE(lvl5): evenly spread in log space, so every size is about
+        // as common as ten times that size
+        f32 size = 0.05f*expf(random_range(rand, 0, logf(200.0f)));
+        item->half_size = v2(size, size*random_range(rand, 0.5f, 1.0f));
+        item->p = hadamard(v2(random_bilateral(rand), random_bilateral(rand)), area*0.5f);
+        item->velocity = v2(random_bilateral(rand), random_bilateral(rand))*2;
+      } break;
+      
+      invalid_default_case();
+    }
+  }
+}
+
+void generate_queries(RandomSequence *rand, v2 area, BenchBody *queries, u32 query_count)
+{
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    BenchBody *query = queries + query_index;
+    query->p = hadamard(v2(random_bilateral(rand), random_bilateral(rand)), area*0.5f);
+    query->velocity = rotate(v2((f32)BULLET_SPEED_LIMIT, 0.0f), random_range(rand, 0, 2*PI));
+    query->half_size = v2(0.2f, 0.2f);
+  }
+}
+
+void move_bodies(BenchBody *bodies, u32 count, f32 dt)
+{
+  for (u32 body_index = 0; body_index < count; body_index++)
+  {
+    bodies[body_index].p += bodies[body_index].velocity*dt;
+  }
+}
+
+PairSet find_pairs_brute(rect2 *item_aabbs, u32 item_count,
+                         rect2 *query_aabbs, u32 query_count)
+{
+  PairSet result = {};
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    for (u32 item_index = 0; item_index < item_count; item_index++)
+    {
+      if (intersects(query_aabbs[query_index], item_aabbs[item_index]))
+      {
+        add_to_pair_set(&result, query_index, item_index);
+      }
+    }
+  }
+  result.candidate_count = result.count;
+  return result;
+}
+
+PairSet find_pairs_grid(rect2 *item_aabbs, u32 item_count,
+                        rect2 *query_aabbs, u32 query_count, v2 area)
+{
+  PairSet result = {};
+  
+  u32 node_count = 0;
+  for (u32 item_index = 0; item_index < item_count; item_index++)
+  {
+    v2 size = get_size(item_aabbs[item_index]);
+    node_count += ((u32)(size.x/GRID_CELL_SIZE) + 2)*((u32)(size.y/GRID_CELL_SIZE) + 2);
+  }
+  
+  SpatialGrid grid;
+  grid_begin(&grid, rect_center_size(v2(), area + v2(2, 2)*GRID_CELL_SIZE),
+             GRID_CELL_SIZE, item_count, node_count);
+  for (u32 item_index = 0; item_index < item_count; item_index++)
+  {
+    grid_insert(&grid, item_index, item_aabbs[item_index]);
+  }
+  
+  u32 *candidates = alloc_array(u32, item_count + 1);
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    rect2 query_aabb = query_aabbs[query_index];
+    u32 candidate_count = grid_query(&grid, query_aabb, candidates, item_count);
+    result.candidate_count += candidate_count;
+    for (u32 candidate_index = 0; candidate_index < candidate_count; candidate_index++)
+    {
+      u32 item_index = candidates[candidate_index];
+      if (intersects(query_aabb, item_aabbs[item_index]))
+      {
+        add_to_pair_set(&result, query_index, item_index);
+      }
+    }
+  }
+  return result;
+}
+
+// NOTE(lvl5): the items are keyed by their index, refreshed in the order
+// they were left in last frame
+PairSet find_pairs_sap(SweepAndPrune *sap, rect2 *item_aabbs,
+                       rect2 *query_aabbs, u32 query_count, u32 *move_count)
+{
+  PairSet result = {};
+  
+  for (u32 item_index = 0; item_index < sap->item_count; item_index++)
+  {
+    SapEntry *item = sap->items + item_index;
+    item->aabb = item_aabbs[item->key];
+  }
+  *move_count = sap_sort(sap, 0, 0);
+  
+  SapEntry *queries = alloc_array(SapEntry, query_count + 1);
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    queries[query_index].aabb = query_aabbs[query_index];
+    queries[query_index].key = query_index;
+    queries[query_index].index = query_index;
+  }
+  
+  u32 pair_capacity = sap_guess_pair_capacity(sap, query_count);
+  BroadphasePair *pairs = alloc_array(BroadphasePair, pair_capacity);
+  u32 pair_count = sap_find_pairs(sap, queries, query_count, pairs, pair_capacity);
+  if (pair_count > pair_capacity)
+  {
+    pair_capacity = pair_count;
+    pairs = alloc_array(BroadphasePair, pair_capacity);
+    sap_find_pairs(sap, queries, query_count, pairs, pair_capacity);
+  }
+  
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    add_to_pair_set(&result, pairs[pair_index].query_index, pairs[pair_index].item_index);
+  }
+  result.candidate_count = pair_count;
+  return result;
+}
+
+// NOTE(lvl5): the leaves of the items are moved like update_tree_asteroids
+// does, in the context the tree lives in
+PairSet find_pairs_tree(AabbTree *tree, u32 *proxies, BenchBody *items,
+                        rect2 *item_aabbs, u32 item_count,
+                        rect2 *query_aabbs, u32 query_count, f32 dt,
+                        Arena *tree_arena, u32 *reinsert_count)
+{
+  PairSet result = {};
+  
+  *reinsert_count = 0;
+  push_bench_arena_context(tree_arena); {
+    for (u32 item_index = 0; item_index < item_count; item_index++)
+    {
+      *reinsert_count += aabb_tree_move(tree, proxies[item_index], item_aabbs[item_index],
+                                        items[item_index].velocity*dt);
+    }
+  }pop_context();
+  
+  u32 pair_capacity = aabb_tree_guess_pair_capacity(tree, query_count);
+  BroadphasePair *pairs = alloc_array(BroadphasePair, pair_capacity);
+  u32 pair_count = aabb_tree_find_pairs(tree, query_aabbs, query_count,
+                                        pairs, pair_capacity);
+  if (pair_count > pair_capacity)
+  {
+    pair_capacity = pair_count;
+    pairs = alloc_array(BroadphasePair, pair_capacity);
+    aabb_tree_find_pairs(tree, query_aabbs, query_count, pairs, pair_capacity);
+  }
+  
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    BroadphasePair pair = pairs[pair_index];
+    if (intersects(query_aabbs[pair.query_index], item_aabbs[pair.item_index]))
+    {
+      add_to_pair_set(&result, pair.query_index, pair.item_index);
+    }
+  }
+  result.candidate_count = pair_count;
+  return result;
+}
+
+// NOTE(lvl5): the query box swept from where it was at the start of the
+// frame to where it is now
+PairSet find_segment_pairs_brute(rect2 *item_aabbs, u32 item_count,
+                                 BenchBody *queries, u32 query_count, f32 dt)
+{
+  PairSet result = {};
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    BenchBody *query = queries + query_index;
+    v2 d_p = query->velocity*dt;
+    for (u32 item_index = 0; item_index < item_count; item_index++)
+    {
+      if (segment_overlaps_aabb(query->p - d_p, d_p, query->half_size,
+                                item_aabbs[item_index]))
+      {
+        add_to_pair_set(&result, query_index, item_index);
+      }
+    }
+  }
+  result.candidate_count = result.count;
+  return result;
+}
+
+PairSet find_segment_pairs_tree(AabbTree *tree, rect2 *item_aabbs, u32 item_count,
+                                BenchBody *queries, u32 query_count, f32 dt)
+{
+  PairSet result = {};
+  u32 *candidates = alloc_array(u32, item_count + 1);
+  for (u32 query_index = 0; query_index < query_count; query_index++)
+  {
+    BenchBody *query = queries + query_index;
+    v2 d_p = query->velocity*dt;
+    u32 candidate_count = aabb_tree_query_segment(tree, query->p - d_p, d_p,
+                                                  query->half_size,
+                                                  candidates, item_count);
+    result.candidate_count += candidate_count;
+    for (u32 candidate_index = 0; candidate_index < candidate_count; candidate_index++)
+    {
+      u32 item_index = candidates[candidate_index];
+      if (segment_overlaps_aabb(query->p - d_p, d_p, query->half_size,
+                                item_aabbs[item_index]))
+      {
+        add_to_pair_set(&result, query_index, item_index);
+      }
+    }
+  }
+  return result;
+}
+
+b32 same_pairs(PairSet a, PairSet b)
+{
+  b32 result = a.count == b.count && a.checksum == b.checksum;
+  return result;
+}
+
+void add_stats(MethodStats *stats, PairSet pairs, u64 nanoseconds)
+{
+  stats->nanoseconds += nanoseconds;
+  stats->pair_count += pairs.count;
+  stats->candidate_count += pairs.candidate_count;
+}
+
+void print_stats(char *distribution_name, char *method_name, MethodStats *stats,
+                 u32 frame_count)
+{
+  printf("%-10s %-6s %12llu %12llu %12llu\n", distribution_name, method_name,
+         stats->nanoseconds/frame_count, stats->pair_count/frame_count,
+         stats->candidate_count/frame_count);
+}
+
+int main(int argc, char **argv)
+{
+  linux_init_default_context();
+  
+  u32 item_count = 20000;
+  u32 query_count = 500;
+  u32 frame_count = 20;
+  for (i32 arg_index = 1; arg_index < argc; arg_index++)
+  {
+    char *arg = argv[arg_index];
+    char *value = arg_index + 1 < argc ? argv[arg_index + 1] : 0;
+    if (value && strcmp(arg, "-items") == 0)
+    {
+      item_count = (u32)atoi(value);
+      arg_index++;
+    }
+    else if (value && strcmp(arg, "-queries") == 0)
+    {
+      query_count = (u32)atoi(value);
+      arg_index++;
+    }
+    else if (value && strcmp(arg, "-frames") == 0)
+    {
+      frame_count = (u32)atoi(value);
+      arg_index++;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-items n] [-queries n] [-frames n]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (item_count == 0 || frame_count == 0)
+  {
+    fprintf(stderr, "nothing to measure\n");
+    return 1;
+  }
+  
+  // NOTE(lvl5): the size of the game world at 800x600
+  v2 area = v2(800, 600)/PIXELS_PER_METER;
+  f32 dt = 1.0f/60.0f;
+  
+  u64 arena_size = megabytes(64) + (u64)item_count*kilobytes(1) + (u64)query_count*kilobytes(1);
+  Arena arena;
+  init(&arena, alloc(arena_size), arena_size);
+  
+  BenchBody *items = alloc_array(BenchBody, item_count);
+  BenchBody *queries = alloc_array(BenchBody, query_count + 1);
+  rect2 *item_aabbs = alloc_array(rect2, item_count);
+  rect2 *query_aabbs = alloc_array(rect2, query_count + 1);
+  SapEntry *sap_items = alloc_array(SapEntry, item_count);
+  u32 *tree_proxies = alloc_array(u32, item_count);
+  
+  u64 tree_arena_size = megabytes(1) + (u64)item_count*8*sizeof(AabbTreeNode);
+  Arena tree_arena;
+  init(&tree_arena, alloc(tree_arena_size), tree_arena_size);
+  
+  char *distribution_names[Distribution_COUNT] = {
+    "uniform",
+    "clustered",
+    "explosion",
+    "mixed",
+  };
+  
+  printf("items: %u, queries: %u, frames: %u\n", item_count, query_count, frame_count);
+  printf("%-10s %-6s %12s %12s %12s\n", "", "", "ns/frame", "pairs", "candidates");
+  
+  RandomSequence rand = make_random_sequence(3153273742);
+  u32 mismatch_count = 0;
+  for (u32 distribution_index = 0;
+       distribution_index < Distribution_COUNT;
+       distribution_index++)
+  {
+    generate_items(&rand, (Distribution)distribution_index, area, items, item_count);
+    generate_queries(&rand, area, queries, query_count);
+    
+    SweepAndPrune sap = {};
+    sap.items = sap_items;
+    sap.item_capacity = item_count;
+    push_bench_arena_context(&arena); {
+      u64 mark = get_mark(&arena);
+      SapEntry *entries = alloc_array(SapEntry, item_count);
+      for (u32 item_index = 0; item_index < item_count; item_index++)
+      {
+        entries[item_index].aabb = get_body_aabb(items + item_index);
+        entries[item_index].key = item_index;
+        entries[item_index].index = item_index;
+      }
+      sap_sort(&sap, entries, item_count);
+      set_mark(&arena, mark);
+    }pop_context();
+    
+    AabbTree tree;
+    aabb_tree_init(&tree);
+    set_mark(&tree_arena, 0);
+    push_bench_arena_context(&tree_arena); {
+      for (u32 item_index = 0; item_index < item_count; item_index++)
+      {
+        tree_proxies[item_index] = aabb_tree_insert(&tree, get_body_aabb(items + item_index),
+                                                    item_index);
+      }
+    }pop_context();
+    
+    MethodStats brute_stats = {};
+    MethodStats grid_stats = {};
+    MethodStats sap_stats = {};
+    MethodStats tree_stats = {};
+    MethodStats brute_segment_stats = {};
+    MethodStats tree_segment_stats = {};
+    u64 sap_move_count = 0;
+    u64 tree_reinsert_count = 0;
+    for (u32 frame_index = 0; frame_index < frame_count; frame_index++)
+    {
+      move_bodies(items, item_count, dt);
+      move_bodies(queries, query_count, dt);
+      for (u32 item_index = 0; item_index < item_count; item_index++)
+      {
+        item_aabbs[item_index] = get_body_aabb(items + item_index);
+      }
+      for (u32 query_index = 0; query_index < query_count; query_index++)
+      {
+        query_aabbs[query_index] = get_query_aabb(queries + query_index, dt);
+      }
+      
+      push_bench_arena_context(&arena); {
+        u64 mark = get_mark(&arena);
+        
+        u64 start = platform_get_nanoseconds();
+        PairSet brute_pairs = find_pairs_brute(item_aabbs, item_count,
+                                               query_aabbs, query_count);
+        add_stats(&brute_stats, brute_pairs, platform_get_nanoseconds() - start);
+        
+        start = platform_get_nanoseconds();
+        PairSet grid_pairs = find_pairs_grid(item_aabbs, item_count,
+                                             query_aabbs, query_count, area);
+        add_stats(&grid_stats, grid_pairs, platform_get_nanoseconds() - start);
+        set_mark(&arena, mark);
+        
+        u32 move_count;
+        start = platform_get_nanoseconds();
+        PairSet sap_pairs = find_pairs_sap(&sap, item_aabbs, query_aabbs, query_count,
+                                           &move_count);
+        add_stats(&sap_stats, sap_pairs, platform_get_nanoseconds() - start);
+        sap_move_count += move_count;
+        set_mark(&arena, mark);
+        
+        u32 reinsert_count;
+        start = platform_get_nanoseconds();
+        PairSet tree_pairs = find_pairs_tree(&tree, tree_proxies, items, item_aabbs,
+                                             item_count, query_aabbs, query_count, dt,
+                                             &tree_arena, &reinsert_count);
+        add_stats(&tree_stats, tree_pairs, platform_get_nanoseconds() - start);
+        tree_reinsert_count += reinsert_count;
+        set_mark(&arena, mark);
+        
+        start = platform_get_nanoseconds();
+        PairSet brute_segment_pairs = find_segment_pairs_brute(item_aabbs, item_count,
+                                                               queries, query_count, dt);
+        add_stats(&brute_segment_stats, brute_segment_pairs,
+                  platform_get_nanoseconds() - start);
+        
+        start = platform_get_nanoseconds();
+        PairSet tree_segment_pairs = find_segment_pairs_tree(&tree, item_aabbs, item_count,
+                                                             queries, query_count, dt);
+        add_stats(&tree_segment_stats, tree_segment_pairs,
+                  platform_get_nanoseconds() - start);
+        set_mark(&arena, mark);
+        
+        if (!same_pairs(brute_pairs, grid_pairs) || !same_pairs(brute_pairs, sap_pairs) ||
+            !same_pairs(brute_pairs, tree_pairs) ||
+            !same_pairs(brute_segment_pairs, tree_segment_pairs))
+        {
+          mismatch_count++;
+        }
+      }pop_context();
+    }
+    
+    char *name = distribution_names[distribution_index];
+    print_stats(name, "brute", &brute_stats, frame_count);
+    print_stats(name, "grid", &grid_stats, frame_count);
+    print_stats(name, "sap", &sap_stats, frame_count);
+    printf("%-10s %-6s %12llu sort moves/frame\n", name, "", sap_move_count/frame_count);
+    print_stats(name, "tree", &tree_stats, frame_count);
+    printf("%-10s %-6s %12llu reinserts/frame, height %d\n", name, "",
+           tree_reinsert_count/frame_count, tree.nodes[tree.root].height);
+    print_stats(name, "seg/bf", &brute_segment_stats, frame_count);
+    print_stats(name, "seg/tr", &tree_segment_stats, frame_count);
+    
+    if (aabb_tree_validate(&tree, tree.root, AABB_TREE_NULL) != item_count)
+    {
+      printf("%-10s the tree lost items\n", name);
+      mismatch_count++;
+    }
+  }
+  
+  if (mismatch_count)
+  {
+    printf("mismatches: %u frames\n", mismatch_count);
+    return 1;
+  }
+  
+  pop_context();
+  return 0;
+}
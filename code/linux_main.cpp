@@ -0,0 +1,63 @@
+#include "platform.h"
+#include "asteroids.cpp"
+#include "linux_platform.cpp"
+
+
+int main(int argc, char **argv)
+{
+  linux_init_default_context();
+  
+  LinuxOptions options = {};
+  options.frame_count = 10000;
+  options.delta_time = 1.0f/60.0f;
+  options.thread_count = -1;
+  if (!linux_parse_options(&options, argc, argv))
+  {
+    return 1;
+  }
+  
+  InputScript script;
+  if (!linux_init_input_script(&script, options.script_file_name))
+  {
+    return 1;
+  }
+  
+  gl_load_functions();
+  
+  
+  GameMemory game_memory = linux_init_game_memory(&options);
+  
+  GameInput game_input = {};
+  game_input.delta_time = options.delta_time;
+  
+  GameScreen game_screen;
+  game_screen.size.x = 800;
+  game_screen.size.y = 600;
+  
+  for (u32 frame_index = 0; frame_index < options.warmup_frame_count; frame_index++)
+  {
+    update_scripted_input(&script, &game_input);
+    game_update(&game_memory, &game_input, &game_screen);
+    reset_temp_storage();
+  }
+  
+  f64 start_time = linux_get_time();
+  
+  for (u32 frame_index = 0; frame_index < options.frame_count; frame_index++)
+  {
+    update_scripted_input(&script, &game_input);
+    
+    game_update(&game_memory, &game_input, &game_screen);
+    
+    reset_temp_storage();
+  }
+  
+  f64 seconds = linux_get_time() - start_time;
+  printf("frames: %u\n", options.frame_count);
+  printf("seconds: %.3f\n", seconds);
+  printf("fps: %.1f\n", options.frame_count/seconds);
+  printf("ms/frame: %.4f\n", seconds*1000.0/options.frame_count);
+  
+  pop_context();
+  return 0;
+}
@@ -0,0 +1,452 @@
+#include "platform.h"
+#include "opengl.h"
+#include "threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// NOTE(lvl5): the linux host is headless. There is no GL context, so the
+// renderer still fills its vertex arrays, but every GL call is a no-op.
+u64 linux_gl_null_proc()
+{
+  return 0;
+}
+
+void APIENTRY linux_gl_get_shader_iv(GLuint shader, GLenum pname, GLint *params)
+{
+  *params = GL_TRUE;
+}
+
+extern "C"
+{
+  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {}
+  void glClear(GLbitfield mask) {}
+  void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {}
+}
+
+void gl_load_functions()
+{
+#define load_opengl_proc(name) *(u64 *)&name = (u64)linux_gl_null_proc
+  load_opengl_proc(glBindBuffer);
+  load_opengl_proc(glGenBuffers);
+  load_opengl_proc(glBufferData);
+  load_opengl_proc(glVertexAttribPointer);
+  load_opengl_proc(glEnableVertexAttribArray);
+  load_opengl_proc(glCreateShader);
+  load_opengl_proc(glShaderSource);
+  load_opengl_proc(glCompileShader);
+  load_opengl_proc(glGetShaderInfoLog);
+  load_opengl_proc(glCreateProgram);
+  load_opengl_proc(glAttachShader);
+  load_opengl_proc(glLinkProgram);
+  load_opengl_proc(glValidateProgram);
+  load_opengl_proc(glDeleteShader);
+  load_opengl_proc(glUseProgram);
+  load_opengl_proc(glDebugMessageCallback);
+  load_opengl_proc(glEnablei);
+  load_opengl_proc(glDebugMessageControl);
+  load_opengl_proc(glGetUniformLocation);
+  load_opengl_proc(glUniform4f);
+  load_opengl_proc(glGenVertexArrays);
+  load_opengl_proc(glBindVertexArray);
+  load_opengl_proc(glDeleteBuffers);
+  load_opengl_proc(glDeleteVertexArrays);
+  
+  glGetShaderiv = linux_gl_get_shader_iv;
+}
+
+
+ALLOCATOR(heap_allocator)
+{
+  byte *result = 0;
+  switch (mode)
+  {
+    case AllocatorMode_ALLOCATE:
+    {
+      void *memory = mmap(0, size, PROT_READ|PROT_WRITE,
+                          MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      assert(memory != MAP_FAILED);
+      result = (byte *)memory;
+    } break;
+    
+    case AllocatorMode_FREE:
+    {
+      i32 error = munmap(old_memory_ptr, old_size);
+      assert(error == 0);
+    } break;
+    
+    invalid_default_case();
+  }
+  return result;
+}
+
+
+String linux_read_entire_file(char *c_file_name)
+{
+  String result = {};
+  
+  i32 file = open(c_file_name, O_RDONLY);
+  if (file == -1)
+  {
+    return result;
+  }
+  
+  struct stat file_stat;
+  fstat(file, &file_stat);
+  u64 file_size = file_stat.st_size;
+  
+  char *buffer = (char *)alloc(file_size);
+  u64 bytes_read = 0;
+  while (bytes_read < file_size)
+  {
+    ssize_t read_result = read(file, buffer + bytes_read, file_size - bytes_read);
+    if (read_result <= 0)
+    {
+      break;
+    }
+    bytes_read += read_result;
+  }
+  close(file);
+  assert(bytes_read == file_size);
+  
+  result = make_string(buffer, (u32)file_size);
+  return result;
+}
+
+String linux_get_work_dir()
+{
+  String full_path;
+  full_path.data = (char *)temp_alloc(PATH_MAX);
+  ssize_t path_count = readlink("/proc/self/exe", full_path.data, PATH_MAX);
+  assert(path_count > 0);
+  full_path.count = (u32)path_count;
+  
+  u32 last_slash_index = find_last_index(full_path, const_string("/"));
+  String result = substring(full_path, 0, last_slash_index + 1);
+  
+  result = concat(result, const_string("../data/"));
+  return result;
+}
+
+String platform_read_entire_file(String file_name)
+{
+  String path = linux_get_work_dir();
+  String full_name = concat(path, file_name);
+  String result = linux_read_entire_file(temp_c_string(full_name));
+  assert(result.data);
+  return result;
+}
+
+void linux_handle_button(Button *b, b32 new_is_down)
+{
+  if (b->is_down && !new_is_down)
+  {
+    b->went_up = true;
+  }
+  else if (!b->is_down && new_is_down)
+  {
+    b->went_down = true;
+  }
+  b->is_down = new_is_down;
+}
+
+u64 platform_get_nanoseconds()
+{
+  timespec time_spec;
+  clock_gettime(CLOCK_MONOTONIC, &time_spec);
+  u64 result = (u64)time_spec.tv_sec*1000000000ULL + (u64)time_spec.tv_nsec;
+  return result;
+}
+
+f64 linux_get_time()
+{
+  f64 result = (f64)platform_get_nanoseconds()*1e-9;
+  return result;
+}
+
+
+// NOTE(lvl5): input script
+/*
+one step per line, blank lines and lines starting with # are skipped:
+<frame count> [up] [left] [right] [space]
+the listed buttons are held for that many frames, the script loops
+*/
+struct InputStep
+{
+  u32 frame_count;
+  b32 is_down[array_count(((GameInput *)0)->buttons)];
+};
+
+struct InputScript
+{
+  InputStep *steps;
+  u32 step_count;
+  
+  u32 step_index;
+  u32 step_frame;
+  
+  RandomSequence seed;
+};
+
+b32 is_whitespace(char c)
+{
+  b32 result = c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  return result;
+}
+
+String next_token(String *line)
+{
+  u32 start = 0;
+  while (start < line->count && is_whitespace(line->data[start]))
+  {
+    start++;
+  }
+  u32 end = start;
+  while (end < line->count && !is_whitespace(line->data[end]))
+  {
+    end++;
+  }
+  
+  String result = substring(*line, start, end);
+  *line = substring(*line, end, line->count);
+  return result;
+}
+
+void parse_input_script(InputScript *script, String src)
+{
+  String button_names[] = {
+    const_string("up"),
+    const_string("left"),
+    const_string("right"),
+    const_string("space"),
+  };
+  
+  u32 line_start = 0;
+  while (line_start < src.count)
+  {
+    u32 line_end = line_start;
+    while (line_end < src.count && src.data[line_end] != '\n')
+    {
+      line_end++;
+    }
+    String line = substring(src, line_start, line_end);
+    line_start = line_end + 1;
+    
+    String count_token = next_token(&line);
+    if (count_token.count == 0 || count_token[0] == '#')
+    {
+      continue;
+    }
+    
+    InputStep step = {};
+    step.frame_count = (u32)string_to_i64(count_token);
+    if (step.frame_count == 0)
+    {
+      continue;
+    }
+    
+    for (String token = next_token(&line);
+         token.count;
+         token = next_token(&line))
+    {
+      for (u32 button_index = 0;
+           button_index < array_count(button_names);
+           button_index++)
+      {
+        if (token == button_names[button_index])
+        {
+          step.is_down[button_index] = true;
+        }
+      }
+    }
+    
+    sb_push(script->steps, step);
+  }
+  
+  script->step_count = sb_count(script->steps);
+}
+
+void update_scripted_input(InputScript *script, GameInput *input)
+{
+  for (u32 button_index = 0;
+       button_index < array_count(input->buttons);
+       button_index++)
+  {
+    Button *button = input->buttons + button_index;
+    button->went_up = false;
+    button->went_down = false;
+  }
+  
+  if (script->step_count)
+  {
+    InputStep *step = script->steps + script->step_index;
+    while (script->step_frame >= step->frame_count)
+    {
+      script->step_frame = 0;
+      script->step_index = (script->step_index + 1) % script->step_count;
+      step = script->steps + script->step_index;
+    }
+    script->step_frame++;
+    
+    for (u32 button_index = 0;
+         button_index < array_count(input->buttons);
+         button_index++)
+    {
+      linux_handle_button(input->buttons + button_index,
+                          step->is_down[button_index]);
+    }
+  }
+  else
+  {
+    // NOTE(lvl5): no script, generate a deterministic stream of presses
+    for (u32 button_index = 0;
+         button_index < array_count(input->buttons);
+         button_index++)
+    {
+      Button *button = input->buttons + button_index;
+      if (random(&script->seed) < 0.05f)
+      {
+        linux_handle_button(button, !button->is_down);
+      }
+    }
+  }
+}
+
+
+void linux_init_default_context()
+{
+  u64 temp_storage_size = kilobytes(40);
+  void *memory = heap_allocator(AllocatorMode_ALLOCATE,
+                                temp_storage_size, 0, 0, 0, 32);
+  __default_temp_storage = {};
+  init(&__default_temp_storage, memory, temp_storage_size);
+  
+  LocalContext heap_ctx = make_context(0);
+  heap_ctx.allocator = heap_allocator;
+  push_context(heap_ctx);
+}
+
+struct LinuxOptions
+{
+  u32 frame_count;
+  u32 warmup_frame_count;
+  f32 delta_time;
+  char *script_file_name;
+  i32 thread_count;
+  u32 asteroid_count;
+  BroadphaseType broadphase;
+};
+
+b32 linux_parse_options(LinuxOptions *options, i32 argc, char **argv)
+{
+  for (i32 arg_index = 1; arg_index < argc; arg_index++)
+  {
+    char *arg = argv[arg_index];
+    b32 has_value = arg_index + 1 < argc;
+    if (strcmp(arg, "-frames") == 0 && has_value)
+    {
+      options->frame_count = (u32)atoi(argv[++arg_index]);
+    }
+    else if (strcmp(arg, "-warmup") == 0 && has_value)
+    {
+      options->warmup_frame_count = (u32)atoi(argv[++arg_index]);
+    }
+    else if (strcmp(arg, "-dt") == 0 && has_value)
+    {
+      options->delta_time = (f32)atof(argv[++arg_index]);
+    }
+    else if (strcmp(arg, "-script") == 0 && has_value)
+    {
+      options->script_file_name = argv[++arg_index];
+    }
+    else if (strcmp(arg, "-threads") == 0 && has_value)
+    {
+      options->thread_count = atoi(argv[++arg_index]);
+    }
+    else if (strcmp(arg, "-asteroids") == 0 && has_value)
+    {
+      options->asteroid_count = (u32)atoi(argv[++arg_index]);
+    }
+    else if (strcmp(arg, "-broadphase") == 0 && has_value &&
+             strcmp(argv[arg_index + 1], "grid") == 0)
+    {
+      options->broadphase = BroadphaseType_GRID;
+      arg_index++;
+    }
+    else if (strcmp(arg, "-broadphase") == 0 && has_value &&
+             strcmp(argv[arg_index + 1], "sap") == 0)
+    {
+      options->broadphase = BroadphaseType_SWEEP_AND_PRUNE;
+      arg_index++;
+    }
+    else if (strcmp(arg, "-broadphase") == 0 && has_value &&
+             strcmp(argv[arg_index + 1], "tree") == 0)
+    {
+      options->broadphase = BroadphaseType_AABB_TREE;
+      arg_index++;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-frames N] [-warmup N] [-dt seconds] [-script file] [-threads N] [-asteroids N] [-broadphase grid|sap|tree]\n",
+              argv[0]);
+      return false;
+    }
+  }
+  return true;
+}
+
+b32 linux_init_input_script(InputScript *script, char *script_file_name)
+{
+  *script = {};
+  script->seed = make_random_sequence(7031925);
+  if (script_file_name)
+  {
+    String src = linux_read_entire_file(script_file_name);
+    if (!src.data)
+    {
+      fprintf(stderr, "could not read input script %s\n", script_file_name);
+      return false;
+    }
+    parse_input_script(script, src);
+  }
+  return true;
+}
+
+// NOTE(lvl5): thread_count is the number of worker threads, the calling
+// thread takes part too. Negative means one per core besides the main one
+JobSystem *linux_start_job_system(i32 thread_count)
+{
+  if (thread_count < 0)
+  {
+    thread_count = (i32)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  }
+  if (thread_count < 0)
+  {
+    thread_count = 0;
+  }
+  
+  JobSystem *system = alloc_struct(JobSystem, alignof(JobSystem));
+  JobWorker *workers = alloc_array(JobWorker, thread_count + 1, alignof(JobWorker));
+  InitJobSystem(system, workers, thread_count + 1);
+  return system;
+}
+
+GameMemory linux_init_game_memory(LinuxOptions *options)
+{
+  GameMemory result = {};
+  // NOTE(lvl5): the stress mode needs room for its entities, the pages
+  // nobody touches don't cost anything
+  result.size = megabytes(128) + options->asteroid_count*kilobytes(4);
+  result.data = alloc(result.size);
+  result.stress_asteroid_count = options->asteroid_count;
+  result.broadphase = options->broadphase;
+  result.job_system = linux_start_job_system(options->thread_count);
+  return result;
+}
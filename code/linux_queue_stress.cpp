@@ -0,0 +1,227 @@
+#include "platform.h"
+#include "utils.h"
+#include "linux_platform.cpp"
+
+/*
+hammers the job system two ways:
+- several producer threads outside the system add jobs at once, so they all
+  go through the shared ring while the workers drain it
+- a tree of jobs where every job adds its children and waits on them, which
+  keeps the deques, stealing and nested waits busy
+Every job adds its own value to a shared sum, so a lost or doubled job shows
+up as a wrong count or a wrong checksum.
+usage: linux_queue_stress [-producers n] [-jobs n] [-depth n] [-threads n]
+*/
+
+struct StressJob
+{
+  u64 value;
+};
+
+struct StressProducer
+{
+  JobSystem *system;
+  JobCounter *counter;
+  StressJob *jobs;
+  u32 job_count;
+};
+
+#define STRESS_TREE_FANOUT 4
+
+// NOTE(lvl5): stored like a heap, the children of node i are
+// i*STRESS_TREE_FANOUT + 1 and up
+struct StressTreeNode
+{
+  JobSystem *system;
+  struct StressTree *tree;
+  u32 index;
+  JobCounter children;
+};
+
+struct StressTree
+{
+  StressTreeNode *nodes;
+  u32 node_count;
+};
+
+std::atomic<u64> global_job_count;
+std::atomic<u64> global_job_sum;
+
+WORKER_FN(stress_job_work)
+{
+  StressJob *job = (StressJob *)data;
+  global_job_count.fetch_add(1, std::memory_order_relaxed);
+  global_job_sum.fetch_add(job->value, std::memory_order_relaxed);
+  return 0;
+}
+
+WORKER_FN(stress_tree_node_work)
+{
+  StressTreeNode *node = (StressTreeNode *)data;
+  StressTree *tree = node->tree;
+  for (u32 child_offset = 1; child_offset <= STRESS_TREE_FANOUT; child_offset++)
+  {
+    u32 child_index = node->index*STRESS_TREE_FANOUT + child_offset;
+    if (child_index < tree->node_count)
+    {
+      platform_add_job(node->system, stress_tree_node_work, tree->nodes + child_index,
+                       &node->children);
+    }
+  }
+  
+  global_job_count.fetch_add(1, std::memory_order_relaxed);
+  global_job_sum.fetch_add(node->index + 1, std::memory_order_relaxed);
+  
+  platform_wait_for_counter(node->system, &node->children);
+  return 0;
+}
+
+void *stress_producer_proc(void *parameter)
+{
+  StressProducer *producer = (StressProducer *)parameter;
+  for (u32 job_index = 0; job_index < producer->job_count; job_index++)
+  {
+    platform_add_job(producer->system, stress_job_work, producer->jobs + job_index,
+                     producer->counter);
+  }
+  return 0;
+}
+
+b32 check_stress_result(char *name, u64 expected_count, u64 expected_sum,
+                        u64 nanoseconds)
+{
+  u64 job_count = global_job_count.load();
+  u64 job_sum = global_job_sum.load();
+  printf("%-10s jobs: %llu, ran: %llu, checksum %s, %.2f ms, %.1f ns/job\n",
+         name, expected_count, job_count,
+         job_sum == expected_sum ? "ok" : "MISMATCH",
+         nanoseconds/1000000.0,
+         expected_count ? (f64)nanoseconds/expected_count : 0.0);
+  
+  b32 result = job_count == expected_count && job_sum == expected_sum;
+  global_job_count.store(0);
+  global_job_sum.store(0);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  linux_init_default_context();
+  
+  u32 producer_count = 4;
+  u32 jobs_per_producer = 1000000;
+  u32 tree_depth = 9;
+  i32 thread_count = -1;
+  for (i32 arg_index = 1; arg_index < argc; arg_index++)
+  {
+    char *arg = argv[arg_index];
+    char *value = arg_index + 1 < argc ? argv[arg_index + 1] : 0;
+    if (value && strcmp(arg, "-producers") == 0)
+    {
+      producer_count = (u32)atoi(value);
+      arg_index++;
+    }
+    else if (value && strcmp(arg, "-jobs") == 0)
+    {
+      jobs_per_producer = (u32)atoi(value);
+      arg_index++;
+    }
+    else if (value && strcmp(arg, "-depth") == 0)
+    {
+      tree_depth = (u32)atoi(value);
+      arg_index++;
+    }
+    else if (value && strcmp(arg, "-threads") == 0)
+    {
+      thread_count = atoi(value);
+      arg_index++;
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-producers n] [-jobs n] [-depth n] [-threads n]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (producer_count == 0)
+  {
+    producer_count = 1;
+  }
+  
+  JobSystem *system = linux_start_job_system(thread_count);
+  
+  u64 expected_count = (u64)producer_count*jobs_per_producer;
+  u64 expected_sum = 0;
+  StressProducer *producers = alloc_array(StressProducer, producer_count);
+  for (u32 producer_index = 0; producer_index < producer_count; producer_index++)
+  {
+    StressProducer *producer = producers + producer_index;
+    producer->system = system;
+    producer->job_count = jobs_per_producer;
+    producer->jobs = alloc_array(StressJob, jobs_per_producer);
+    for (u32 job_index = 0; job_index < jobs_per_producer; job_index++)
+    {
+      // NOTE(lvl5): unique per job, so swapping two jobs can't cancel out
+      u64 value = ((u64)producer_index << 32) | (job_index + 1);
+      producer->jobs[job_index].value = value;
+      expected_sum += value;
+    }
+  }
+  
+  JobCounter producer_counter = {};
+  for (u32 producer_index = 0; producer_index < producer_count; producer_index++)
+  {
+    producers[producer_index].counter = &producer_counter;
+  }
+  
+  b32 passed = true;
+  
+  u64 start = platform_get_nanoseconds();
+  pthread_t *threads = alloc_array(pthread_t, producer_count);
+  for (u32 producer_index = 0; producer_index < producer_count; producer_index++)
+  {
+    pthread_create(threads + producer_index, 0, stress_producer_proc,
+                   producers + producer_index);
+  }
+  for (u32 producer_index = 0; producer_index < producer_count; producer_index++)
+  {
+    pthread_join(threads[producer_index], 0);
+  }
+  platform_wait_for_counter(system, &producer_counter);
+  u64 nanoseconds = platform_get_nanoseconds() - start;
+  passed &= check_stress_result("producers", expected_count, expected_sum, nanoseconds);
+  
+  StressTree tree;
+  tree.node_count = 0;
+  u32 level_count = 1;
+  for (u32 depth = 0; depth <= tree_depth; depth++)
+  {
+    tree.node_count += level_count;
+    level_count *= STRESS_TREE_FANOUT;
+  }
+  tree.nodes = alloc_array(StressTreeNode, tree.node_count);
+  u64 tree_sum = 0;
+  for (u32 node_index = 0; node_index < tree.node_count; node_index++)
+  {
+    StressTreeNode *node = tree.nodes + node_index;
+    node->system = system;
+    node->tree = &tree;
+    node->index = node_index;
+    node->children.pending.store(0);
+    tree_sum += node_index + 1;
+  }
+  
+  start = platform_get_nanoseconds();
+  JobCounter root_counter = {};
+  platform_add_job(system, stress_tree_node_work, tree.nodes, &root_counter);
+  platform_wait_for_counter(system, &root_counter);
+  nanoseconds = platform_get_nanoseconds() - start;
+  passed &= check_stress_result("tree", tree.node_count, tree_sum, nanoseconds);
+  
+  if (!passed)
+  {
+    return 1;
+  }
+  
+  pop_context();
+  return 0;
+}
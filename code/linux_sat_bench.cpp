@@ -0,0 +1,375 @@
+#include "platform.h"
+#include "asteroids.cpp"
+#include "linux_platform.cpp"
+
+/*
+compares the scalar separating axis test (polygons_intersect) with the SSE
+one (polygons_intersect_soa), and the SSE one behind a bounding circle reject.
+Then triangles and boxes against polygons of every vertex count, generic SSE
+against the specializations picked by polygons_intersect_soa_dispatch.
+Every random pair has to give the same answer from all of them before
+anything is timed.
+Last the swept test (sweep_soa) is checked against the static scalar test
+run at SWEEP_SUBSTEP_COUNT + 1 points along the motion.
+*/
+
+struct PolygonPair
+{
+  Polygon a;
+  Polygon b;
+  PolygonSoa a_soa;
+  PolygonSoa b_soa;
+  
+  v2 a_center;
+  v2 b_center;
+  f32 a_radius;
+  f32 b_radius;
+};
+
+Polygon place_polygon(RandomSequence *rand, Polygon shape, f32 spread, v2 *center, f32 *radius)
+{
+  Transform t;
+  t.p = v2(random_bilateral(rand), random_bilateral(rand))*spread;
+  t.angle = random_range(rand, 0, 2*PI);
+  f32 scale = random_range(rand, 0.5f, 2.5f);
+  t.scale = v2(scale, scale);
+  
+  Polygon result = transform_polygon(shape, t);
+  
+  *center = t.p;
+  *radius = 0;
+  for (u32 vertex_index = 0; vertex_index < result.count; vertex_index++)
+  {
+    f32 distance = len(result.vertices[vertex_index] - t.p);
+    if (distance > *radius)
+    {
+      *radius = distance;
+    }
+  }
+  return result;
+}
+
+Polygon random_world_polygon(RandomSequence *rand, f32 spread, v2 *center, f32 *radius)
+{
+  u32 count = random_range_i32(rand, 3, 16);
+  Polygon shape = generate_random_convex_polygon(rand, count, 1.0f);
+  reset_temp_storage();
+  
+  Polygon result = place_polygon(rand, shape, spread, center, radius);
+  return result;
+}
+
+b32 circle_reject_intersect(PolygonPair *pair)
+{
+  b32 result = false;
+  if (circles_overlap(pair->a_center, pair->a_radius, pair->b_center, pair->b_radius))
+  {
+    result = polygons_intersect_soa(&pair->a_soa, &pair->b_soa);
+  }
+  return result;
+}
+
+// NOTE(lvl5): small_shape against random polygons with count vertices,
+// returns false on a mismatch
+b32 bench_fixed_count(RandomSequence *rand, char *name, Polygon small_shape, u32 count,
+                      PolygonPair *pairs, u32 pair_count, u32 repeat_count)
+{
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    PolygonPair *pair = pairs + pair_index;
+    pair->a = place_polygon(rand, small_shape, 1.0f, &pair->a_center, &pair->a_radius);
+    Polygon shape = generate_random_convex_polygon(rand, count, 1.0f);
+    reset_temp_storage();
+    pair->b = place_polygon(rand, shape, 1.0f, &pair->b_center, &pair->b_radius);
+    polygon_to_soa(&pair->a, &pair->a_soa);
+    polygon_to_soa(&pair->b, &pair->b_soa);
+  }
+  
+  u32 mismatch_count = 0;
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    PolygonPair *pair = pairs + pair_index;
+    b32 generic_result = polygons_intersect_soa(&pair->a_soa, &pair->b_soa);
+    if (generic_result != polygons_intersect_soa_dispatch(&pair->a_soa, &pair->b_soa) ||
+        generic_result != polygons_intersect_soa_dispatch(&pair->b_soa, &pair->a_soa))
+    {
+      mismatch_count++;
+    }
+  }
+  
+  u32 generic_sum = 0;
+  u64 generic_start = platform_get_nanoseconds();
+  for (u32 repeat_index = 0; repeat_index < repeat_count; repeat_index++)
+  {
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      PolygonPair *pair = pairs + pair_index;
+      generic_sum += polygons_intersect_soa(&pair->a_soa, &pair->b_soa);
+    }
+  }
+  u64 generic_nanoseconds = platform_get_nanoseconds() - generic_start;
+  
+  u32 fixed_sum = 0;
+  u64 fixed_start = platform_get_nanoseconds();
+  for (u32 repeat_index = 0; repeat_index < repeat_count; repeat_index++)
+  {
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      PolygonPair *pair = pairs + pair_index;
+      fixed_sum += polygons_intersect_soa_dispatch(&pair->a_soa, &pair->b_soa);
+    }
+  }
+  u64 fixed_nanoseconds = platform_get_nanoseconds() - fixed_start;
+  
+  assert(generic_sum == fixed_sum);
+  
+  f64 test_count = (f64)pair_count*repeat_count;
+  printf("%-4s vs %-3u %10.2f %10.2f%s\n", name, count,
+         generic_nanoseconds/test_count, fixed_nanoseconds/test_count,
+         mismatch_count ? "  MISMATCH" : "");
+  return mismatch_count == 0;
+}
+
+Polygon move_polygon(Polygon poly, v2 d_p)
+{
+  for (u32 vertex_index = 0; vertex_index < poly.count; vertex_index++)
+  {
+    poly.vertices[vertex_index] += d_p;
+  }
+  return poly;
+}
+
+Polygon inflate_polygon(Polygon poly, v2 center, f32 scale)
+{
+  for (u32 vertex_index = 0; vertex_index < poly.count; vertex_index++)
+  {
+    v2 *v = poly.vertices + vertex_index;
+    *v = center + (*v - center)*scale;
+  }
+  return poly;
+}
+
+// NOTE(lvl5): the substeps can only find the first contact to within a
+// step, and miss contacts shorter than a step. Those have to hold up when
+// the static test is run at the time sweep_soa found, with the moving
+// shape a bit bigger so touching edges count
+#define SWEEP_SUBSTEP_COUNT 256
+#define SWEEP_T_EPSILON 1e-4f
+
+b32 check_sweep(RandomSequence *rand, Polygon small_shape, u32 pair_count, u32 repeat_count)
+{
+  PolygonPair *pairs = alloc_array(PolygonPair, pair_count);
+  v2 *motions = alloc_array(v2, pair_count);
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    PolygonPair *pair = pairs + pair_index;
+    pair->a = place_polygon(rand, small_shape, 3.0f, &pair->a_center, &pair->a_radius);
+    pair->b = random_world_polygon(rand, 1.0f, &pair->b_center, &pair->b_radius);
+    polygon_to_soa(&pair->a, &pair->a_soa);
+    polygon_to_soa(&pair->b, &pair->b_soa);
+    
+    // NOTE(lvl5): mostly aimed at the other one, from far enough to skip it
+    v2 target = pair->b_center + v2(random_bilateral(rand), random_bilateral(rand))*2.0f;
+    motions[pair_index] = (target - pair->a_center)*random_range(rand, 0.5f, 3.0f);
+  }
+  
+  u32 hit_count = 0;
+  u32 tunnel_count = 0;
+  u32 graze_count = 0;
+  u32 mismatch_count = 0;
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    PolygonPair *pair = pairs + pair_index;
+    v2 d_p = motions[pair_index];
+    SweepResult sweep = sweep_soa(&pair->a_soa, d_p, &pair->b_soa);
+    
+    u32 first_step = SWEEP_SUBSTEP_COUNT + 1;
+    for (u32 step = 0; step <= SWEEP_SUBSTEP_COUNT; step++)
+    {
+      Polygon a = move_polygon(pair->a, d_p*((f32)step/SWEEP_SUBSTEP_COUNT));
+      if (polygons_intersect(&a, &pair->b))
+      {
+        first_step = step;
+        break;
+      }
+    }
+    
+    if (first_step <= SWEEP_SUBSTEP_COUNT)
+    {
+      f32 max_t = (f32)first_step/SWEEP_SUBSTEP_COUNT + SWEEP_T_EPSILON;
+      f32 min_t = first_step ? (f32)(first_step - 1)/SWEEP_SUBSTEP_COUNT - SWEEP_T_EPSILON : 0;
+      if (!sweep.hit || sweep.t > max_t || sweep.t < min_t)
+      {
+        mismatch_count++;
+      }
+    }
+    else if (sweep.hit)
+    {
+      Polygon a = move_polygon(pair->a, d_p*sweep.t);
+      a = inflate_polygon(a, pair->a_center + d_p*sweep.t, 1.01f);
+      if (!polygons_intersect(&a, &pair->b))
+      {
+        mismatch_count++;
+      }
+      graze_count++;
+    }
+    
+    if (sweep.hit)
+    {
+      hit_count++;
+      Polygon end_a = move_polygon(pair->a, d_p);
+      if (!polygons_intersect(&end_a, &pair->b))
+      {
+        tunnel_count++;
+      }
+    }
+  }
+  
+  printf("\nsweep pairs: %u, hits: %u, missed at the end position: %u, "
+         "between substeps: %u, mismatches: %u\n",
+         pair_count, hit_count, tunnel_count, graze_count, mismatch_count);
+  if (mismatch_count)
+  {
+    return false;
+  }
+  
+  u32 sweep_sum = 0;
+  u64 sweep_start = platform_get_nanoseconds();
+  for (u32 repeat_index = 0; repeat_index < repeat_count; repeat_index++)
+  {
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      PolygonPair *pair = pairs + pair_index;
+      sweep_sum += sweep_soa(&pair->a_soa, motions[pair_index], &pair->b_soa).hit;
+    }
+  }
+  u64 sweep_nanoseconds = platform_get_nanoseconds() - sweep_start;
+  
+  assert(sweep_sum == hit_count*repeat_count);
+  printf("%-16s %10.2f ns/pair\n", "sweep",
+         sweep_nanoseconds/((f64)pair_count*repeat_count));
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  linux_init_default_context();
+  
+  u32 pair_count = 4096;
+  u32 repeat_count = 200;
+  
+  RandomSequence rand = make_random_sequence(3153273742);
+  PolygonPair *pairs = alloc_array(PolygonPair, pair_count);
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    PolygonPair *pair = pairs + pair_index;
+    pair->a = random_world_polygon(&rand, 2.0f, &pair->a_center, &pair->a_radius);
+    pair->b = random_world_polygon(&rand, 2.0f, &pair->b_center, &pair->b_radius);
+    polygon_to_soa(&pair->a, &pair->a_soa);
+    polygon_to_soa(&pair->b, &pair->b_soa);
+  }
+  
+  u32 hit_count = 0;
+  u32 circle_reject_count = 0;
+  u32 mismatch_count = 0;
+  for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+  {
+    PolygonPair *pair = pairs + pair_index;
+    b32 scalar_result = polygons_intersect(&pair->a, &pair->b);
+    b32 soa_result = polygons_intersect_soa(&pair->a_soa, &pair->b_soa);
+    b32 circle_result = circle_reject_intersect(pair);
+    if (scalar_result != soa_result || scalar_result != circle_result)
+    {
+      mismatch_count++;
+    }
+    if (!circles_overlap(pair->a_center, pair->a_radius, pair->b_center, pair->b_radius))
+    {
+      circle_reject_count++;
+    }
+    if (scalar_result)
+    {
+      hit_count++;
+    }
+  }
+  
+  printf("pairs: %u, intersecting: %u, circle rejects: %u, mismatches: %u\n",
+         pair_count, hit_count, circle_reject_count, mismatch_count);
+  if (mismatch_count)
+  {
+    return 1;
+  }
+  
+  // NOTE(lvl5): the sums keep the compiler from dropping the loops
+  u32 scalar_sum = 0;
+  u64 scalar_start = platform_get_nanoseconds();
+  for (u32 repeat_index = 0; repeat_index < repeat_count; repeat_index++)
+  {
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      PolygonPair *pair = pairs + pair_index;
+      scalar_sum += polygons_intersect(&pair->a, &pair->b);
+    }
+  }
+  u64 scalar_nanoseconds = platform_get_nanoseconds() - scalar_start;
+  
+  u32 soa_sum = 0;
+  u64 soa_start = platform_get_nanoseconds();
+  for (u32 repeat_index = 0; repeat_index < repeat_count; repeat_index++)
+  {
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      PolygonPair *pair = pairs + pair_index;
+      soa_sum += polygons_intersect_soa(&pair->a_soa, &pair->b_soa);
+    }
+  }
+  u64 soa_nanoseconds = platform_get_nanoseconds() - soa_start;
+  
+  u32 circle_sum = 0;
+  u64 circle_start = platform_get_nanoseconds();
+  for (u32 repeat_index = 0; repeat_index < repeat_count; repeat_index++)
+  {
+    for (u32 pair_index = 0; pair_index < pair_count; pair_index++)
+    {
+      circle_sum += circle_reject_intersect(pairs + pair_index);
+    }
+  }
+  u64 circle_nanoseconds = platform_get_nanoseconds() - circle_start;
+  
+  assert(scalar_sum == soa_sum && scalar_sum == circle_sum);
+  
+  f64 test_count = (f64)pair_count*repeat_count;
+  printf("%-16s %10.2f ns/pair\n", "scalar", scalar_nanoseconds/test_count);
+  printf("%-16s %10.2f ns/pair\n", "sse", soa_nanoseconds/test_count);
+  printf("%-16s %10.2f ns/pair\n", "circle + sse", circle_nanoseconds/test_count);
+  
+  Polygon triangle;
+  triangle.count = 3;
+  triangle.vertices[0] = v2(0.4f, 0.0f);
+  triangle.vertices[1] = v2(-0.4f, 0.3f);
+  triangle.vertices[2] = v2(-0.4f, -0.3f);
+  Polygon box = rect2_to_polygon(rect_center_size(v2(), v2(0.8f, 0.5f)));
+  
+  printf("\n%-11s %10s %10s  (ns/pair)\n", "", "generic", "fixed");
+  b32 passed = true;
+  u32 count_pair_count = 1024;
+  for (u32 count = 3; count <= 16; count++)
+  {
+    passed &= bench_fixed_count(&rand, "tri", triangle, count,
+                                pairs, count_pair_count, repeat_count);
+  }
+  for (u32 count = 3; count <= 16; count++)
+  {
+    passed &= bench_fixed_count(&rand, "box", box, count,
+                                pairs, count_pair_count, repeat_count);
+  }
+  
+  Polygon bullet = rect2_to_polygon(rect_center_size(v2(), v2(0.4f, 0.4f)));
+  passed &= check_sweep(&rand, bullet, count_pair_count, repeat_count);
+  if (!passed)
+  {
+    return 1;
+  }
+  
+  pop_context();
+  return 0;
+}
@@ -3,8 +3,10 @@
 
 #include "utils.h"
 //#include <Windows.h>
+#ifdef _WIN32
 #define APIENTRY __stdcall
 #define WINGDIAPI __declspec(dllimport)
+#endif
 
 #include <GL/gl.h>
 #include "KHR/glext.h"
@@ -3,10 +3,79 @@
 
 #include "utils.h"
 
+// NOTE(lvl5): utils.h defines a swap macro that breaks the std headers
+#pragma push_macro("swap")
+#undef swap
+#include <atomic>
+#pragma pop_macro("swap")
+
+enum FramePhase
+{
+  FramePhase_PARTICLES,
+  FramePhase_MOVEMENT,
+  FramePhase_ENTITY_UPDATE,
+  FramePhase_RENDER,
+  
+  FramePhase_COUNT,
+};
+
+// NOTE(lvl5): things the game counts every frame, so the win of a change can
+// be measured
+enum FrameCounter
+{
+  // NOTE(lvl5): pairs that got past the bounding circles
+  FrameCounter_SAT_PAIRS,
+  // NOTE(lvl5): pairs that had an axis cached from last frame, and the ones
+  // that axis still separated
+  FrameCounter_SAT_CACHE_LOOKUPS,
+  FrameCounter_SAT_CACHE_HITS,
+  // NOTE(lvl5): axes projected on, cached ones included
+  FrameCounter_SAT_AXES,
+  
+  FrameCounter_COUNT,
+};
+
+// NOTE(lvl5): what the game finds the asteroids near a shape with, see
+// broadphase.h
+enum BroadphaseType
+{
+  BroadphaseType_GRID,
+  BroadphaseType_SWEEP_AND_PRUNE,
+  BroadphaseType_AABB_TREE,
+  
+  BroadphaseType_COUNT,
+};
+
+struct JobSystem;
+
+#define WORKER_FN(name) void *name(void *data)
+typedef WORKER_FN(WorkerFn);
+
+// NOTE(lvl5): every job added with a counter bumps it, and drops it when
+// the job is done. Start it at zero: JobCounter counter = {};
+struct JobCounter
+{
+  std::atomic<u32> pending;
+};
+
 struct GameMemory
 {
   byte *data;
   u64 size;
+  
+  // NOTE(lvl5): can be 0, then the game does all the work on its own thread
+  JobSystem *job_system;
+  
+  // NOTE(lvl5): when not 0 every wave is this many small asteroids and the
+  // player can't die, for profiling
+  u32 stress_asteroid_count;
+  
+  // NOTE(lvl5): read once, when the game starts
+  BroadphaseType broadphase;
+  
+  // NOTE(lvl5): written by the game every frame, read by the platform
+  u64 phase_nanoseconds[FramePhase_COUNT];
+  u64 frame_counters[FrameCounter_COUNT];
 };
 
 
@@ -39,6 +108,16 @@ struct GameScreen
 };
 
 String platform_read_entire_file(String file_name);
+u64 platform_get_nanoseconds();
+void platform_add_job(JobSystem *system, WorkerFn *workerFn, void *data,
+                      JobCounter *counter);
+// NOTE(lvl5): runs other jobs until the counter drops to zero, so it is fine
+// to call from inside a job
+void platform_wait_for_counter(JobSystem *system, JobCounter *counter);
+
+#define BEGIN_TIMED_PHASE(phase) u64 phase_start_##phase = platform_get_nanoseconds()
+#define END_TIMED_PHASE(memory, phase) (memory)->phase_nanoseconds[FramePhase_##phase] = \
+platform_get_nanoseconds() - phase_start_##phase
 
 #define GAME_UPDATE(name) void name(GameMemory *memory, GameInput *input, GameScreen *screen)
 typedef GAME_UPDATE(type_game_update);
@@ -3,6 +3,7 @@
 
 #include "platform.h"
 #include "opengl.h"
+#include "wide_math.h"
 
 
 struct Polygon 
@@ -25,18 +26,52 @@ struct Transform
   f32 angle;
 };
 
+// NOTE(lvl5): shapes never change once they are added to the pool, entities
+// and render entries only keep a ShapeIndex. Everything is in local space,
+// normals[i] is the outward facing unit normal of the edge from vertex i
+// to vertex i + 1, radius is the distance to the furthest vertex.
+// vertex_x and the others hold the same as separate x and y arrays, padded
+// to padded_count by repeating the first one, so the vertex streams and the
+// collision tests can always take them 4 at a time
+typedef u16 ShapeIndex;
+
+struct Shape
+{
+  v2 vertices[16];
+  v2 normals[16];
+  alignas(16) f32 vertex_x[16];
+  alignas(16) f32 vertex_y[16];
+  alignas(16) f32 normal_x[16];
+  alignas(16) f32 normal_y[16];
+  f32 radius;
+  u32 count;
+  // NOTE(lvl5): count rounded up to a multiple of 4
+  u32 padded_count;
+};
+
+struct ShapePool
+{
+  Shape *shapes;
+  u32 count;
+  u32 capacity;
+};
+
 struct RenderGroup
 {
   Buffer buffer;
   Transform transform;
   GameScreen *screen;
+  ShapePool *shapes;
 };
 
 enum RenderEntryType
 {
   RenderEntryType_NONE,
   RenderEntryType_Polygon,
-  RenderEntryType_Rect
+  RenderEntryType_Rect,
+  RenderEntryType_Quads,
+  RenderEntryType_Shape,
+  RenderEntryType_ShapeRect,
 };
 
 struct RenderEntryPolygon
@@ -51,6 +86,32 @@ struct RenderEntryRect
   v4 color;
 };
 
+// NOTE(lvl5): the shape goes through t and then the group transform when the
+// group is drawn
+struct RenderEntryShape
+{
+  Transform t;
+  v4 color;
+  ShapeIndex shape;
+};
+
+struct RenderEntryShapeRect
+{
+  Transform t;
+  v4 color;
+  ShapeIndex shape;
+};
+
+// NOTE(lvl5): a batch of filled quads, 4 vertices each in rect2_to_polygon
+// order, already in screen space. The vertices are not copied, they have to
+// live until draw_render_group
+struct RenderEntryQuads
+{
+  v2 *vertices;
+  u32 quad_count;
+  v4 color;
+};
+
 
 
 #define PIXELS_PER_METER 40
@@ -79,13 +140,10 @@ void alloc_render_group_buffer(RenderGroup *group, GameScreen *screen, u32 capac
   group->buffer.data = alloc(capacity);
   group->buffer.size = 0;
 }
-v2 transform_vector(v2 v, Transform t)
+
+m2x3 transform_to_m2x3(Transform t)
 {
-  v2 result;
-  result = v;
-  result = hadamard(result, t.scale);
-  result = rotate(result, t.angle);
-  result += t.p;
+  m2x3 result = make_m2x3(t.p, t.angle, t.scale);
   return result;
 }
 
@@ -105,22 +163,188 @@ Transform translate(Transform t, v2 p)
   return result;
 }
 
-Polygon transform_polygon(Polygon s, Transform t)
+void init_shape_pool(ShapePool *pool, u32 capacity)
 {
-  Polygon result;
-  result.count = s.count;
+  assert(capacity <= U16_MAX + 1);
+  pool->shapes = alloc_array(Shape, capacity);
+  pool->count = 0;
+  pool->capacity = capacity;
+}
+
+// NOTE(lvl5): polygon has to be convex, it can be wound either way
+ShapeIndex add_shape(ShapePool *pool, Polygon *polygon)
+{
+  assert(pool->count < pool->capacity);
+  assert(polygon->count >= 3 && polygon->count <= array_count(polygon->vertices));
+  ShapeIndex result = (ShapeIndex)pool->count++;
+  Shape *shape = pool->shapes + result;
+  shape->count = polygon->count;
+  shape->padded_count = (polygon->count + 3)/4*4;
+  shape->radius = 0;
+  
+  f32 twice_area = 0;
+  for (u32 vertex_index = 0;
+       vertex_index < polygon->count;
+       vertex_index++)
+  {
+    u32 next_vertex_index = vertex_index + 1 == polygon->count ? 0 : vertex_index + 1;
+    v2 a = polygon->vertices[vertex_index];
+    v2 b = polygon->vertices[next_vertex_index];
+    twice_area += a.x*b.y - b.x*a.y;
+  }
+  f32 normal_sign = twice_area < 0 ? 1.0f : -1.0f;
   
   for (u32 vertex_index = 0;
-       vertex_index < s.count;
+       vertex_index < polygon->count;
        vertex_index++)
   {
-    v2 v = s.vertices[vertex_index];
-    result.vertices[vertex_index] = transform_vector(v, t);
+    u32 next_vertex_index = vertex_index + 1 == polygon->count ? 0 : vertex_index + 1;
+    v2 vertex = polygon->vertices[vertex_index];
+    v2 edge = polygon->vertices[next_vertex_index] - vertex;
+    
+    shape->vertices[vertex_index] = vertex;
+    shape->normals[vertex_index] = normalize(perp(edge))*normal_sign;
+    shape->vertex_x[vertex_index] = vertex.x;
+    shape->vertex_y[vertex_index] = vertex.y;
+    shape->normal_x[vertex_index] = shape->normals[vertex_index].x;
+    shape->normal_y[vertex_index] = shape->normals[vertex_index].y;
+    
+    f32 vertex_distance = len(vertex);
+    if (vertex_distance > shape->radius)
+    {
+      shape->radius = vertex_distance;
+    }
   }
   
+  for (u32 vertex_index = polygon->count;
+       vertex_index < shape->padded_count;
+       vertex_index++)
+  {
+    shape->vertex_x[vertex_index] = shape->vertex_x[0];
+    shape->vertex_y[vertex_index] = shape->vertex_y[0];
+    shape->normal_x[vertex_index] = shape->normal_x[0];
+    shape->normal_y[vertex_index] = shape->normal_y[0];
+  }
+  return result;
+}
+
+Shape *get_shape(ShapePool *pool, ShapeIndex index)
+{
+  assert(index < pool->count);
+  Shape *result = pool->shapes + index;
   return result;
 }
 
+// NOTE(lvl5): bounding circle around t.p
+f32 get_world_radius(Shape *shape, Transform t)
+{
+  f32 scale = t.scale.x > t.scale.y ? t.scale.x : t.scale.y;
+  f32 result = shape->radius*scale;
+  return result;
+}
+
+// NOTE(lvl5): loose, but doesn't look at the vertices
+rect2 get_shape_aabb(Shape *shape, Transform t)
+{
+  f32 radius = get_world_radius(shape, t);
+  rect2 result = rect_center_size(t.p, v2(radius, radius)*2);
+  return result;
+}
+
+Polygon transform_polygon(Polygon s, m2x3 m)
+{
+  Polygon result;
+  result.count = s.count;
+  transform_points(m, s.vertices, result.vertices, s.count);
+  return result;
+}
+
+Polygon transform_polygon(Polygon s, Transform t)
+{
+  Polygon result = transform_polygon(s, transform_to_m2x3(t));
+  return result;
+}
+
+
+// NOTE(lvl5): vertex streams
+/*
+the vertices of many entities, as separate x and y arrays, go through their
+matrices in one call and come out one after the other. Every entity gets a
+VertexRange that says where its vertices are, which matrix they go through
+and where they go. Ranges are padded to a multiple of 4, like the arrays of
+a Shape, so the whole stream goes through 4 at a time with no scalar tail.
+The math is the same as m2x3 * v2, so both give the same result. result can
+be the input
+*/
+struct VertexRange
+{
+  f32 *x;
+  f32 *y;
+  u32 count;
+  u32 matrix_index;
+  // NOTE(lvl5): in the result arrays
+  u32 first;
+};
+
+// NOTE(lvl5): count has to be a multiple of 4
+void transform_vertices(m2x3 m, f32 *x, f32 *y, f32 *result_x, f32 *result_y, u32 count)
+{
+  assert((count & 3) == 0);
+  for (u32 vertex_index = 0; vertex_index < count; vertex_index += 4)
+  {
+    v2x4 v = m*load_v2x4(x + vertex_index, y + vertex_index);
+    store(result_x + vertex_index, result_y + vertex_index, v);
+  }
+}
+
+void transform_vertex_stream(m2x3 *matrices, VertexRange *ranges, u32 range_count,
+                             f32 *result_x, f32 *result_y)
+{
+  for (u32 range_index = 0; range_index < range_count; range_index++)
+  {
+    VertexRange *range = ranges + range_index;
+    transform_vertices(matrices[range->matrix_index], range->x, range->y,
+                       result_x + range->first, result_y + range->first, range->count);
+  }
+}
+
+// NOTE(lvl5): collects ranges and matrices, then transforms them all at
+// once. ranges and matrices are stretchy buffers, start it zeroed
+struct VertexStream
+{
+  VertexRange *ranges;
+  m2x3 *matrices;
+  u32 vertex_count;
+  
+  f32 *x;
+  f32 *y;
+};
+
+// NOTE(lvl5): returns where the vertices will be in VertexStream::x and y.
+// x and y have to be padded to count, a multiple of 4
+u32 push_vertex_stream(VertexStream *stream, f32 *x, f32 *y, u32 count, m2x3 m)
+{
+  assert((count & 3) == 0);
+  VertexRange range;
+  range.x = x;
+  range.y = y;
+  range.count = count;
+  range.matrix_index = sb_count(stream->matrices);
+  range.first = stream->vertex_count;
+  sb_push(stream->matrices, m);
+  sb_push(stream->ranges, range);
+  stream->vertex_count += count;
+  return range.first;
+}
+
+void transform_vertex_stream(VertexStream *stream)
+{
+  stream->x = alloc_array(f32, stream->vertex_count + 1);
+  stream->y = alloc_array(f32, stream->vertex_count + 1);
+  transform_vertex_stream(stream->matrices, stream->ranges, sb_count(stream->ranges),
+                          stream->x, stream->y);
+}
+
 #define push_buffer(buffer, T) (T *)push_buffer_(buffer, sizeof(T))
 void *push_buffer_(Buffer *buffer, u32 size)
 {
@@ -155,8 +379,8 @@ void *push_render_entry_(RenderGroup *group, RenderEntryType type, u32 size)
 void push_polygon(RenderGroup *group, Polygon polygon, Transform t, v4 color)
 {
   RenderEntryPolygon *entry = push_render_entry(group, Polygon);
-  entry->shape = transform_polygon(transform_polygon(polygon, t), 
-                                   group->transform);
+  m2x3 m = transform_to_m2x3(group->transform)*transform_to_m2x3(t);
+  entry->shape = transform_polygon(polygon, m);
   entry->color = color;
 }
 
@@ -186,9 +410,35 @@ void push_rect(RenderGroup *group, rect2 rect, Transform t, v4 color)
 {
   RenderEntryRect *entry = push_render_entry(group, Rect);
   
-  Polygon shape = rect2_to_polygon(rect);
-  entry->shape = transform_polygon(transform_polygon(shape, t), 
-                                   group->transform);
+  m2x3 m = transform_to_m2x3(group->transform)*transform_to_m2x3(t);
+  entry->shape = transform_polygon(rect2_to_polygon(rect), m);
+  entry->color = color;
+}
+
+
+void push_shape(RenderGroup *group, ShapeIndex shape, Transform t, v4 color)
+{
+  RenderEntryShape *entry = push_render_entry(group, Shape);
+  entry->t = t;
+  entry->color = color;
+  entry->shape = shape;
+}
+
+// NOTE(lvl5): the shape has to be a quad in rect2_to_polygon order
+void push_shape_rect(RenderGroup *group, ShapeIndex shape, Transform t, v4 color)
+{
+  assert(get_shape(group->shapes, shape)->count == 4);
+  RenderEntryShapeRect *entry = push_render_entry(group, ShapeRect);
+  entry->t = t;
+  entry->color = color;
+  entry->shape = shape;
+}
+
+void push_quads(RenderGroup *group, v2 *vertices, u32 quad_count, v4 color)
+{
+  RenderEntryQuads *entry = push_render_entry(group, Quads);
+  entry->vertices = vertices;
+  entry->quad_count = quad_count;
   entry->color = color;
 }
 
@@ -199,32 +449,106 @@ struct VertexInfo
   v4 color;
 };
 
+struct RenderEntryRef
+{
+  RenderEntryType type;
+  void *entry;
+  // NOTE(lvl5): into the vertex stream, for shape entries
+  u32 first_vertex;
+};
+
 
 void draw_render_group(RenderGroup *group, u32 shader)
 {
+  Buffer *buffer = &group->buffer;
+  
+  m2x3 group_m = transform_to_m2x3(group->transform);
+  
+  // NOTE(lvl5): the entries are taken off the buffer first. The vertices of
+  // every shape go into one stream that gets transformed in one go, and it
+  // is known how many vertices and indices there will be before any are made
+  RenderEntryRef *refs = 0;
+  sb_reserve(refs, 256);
+  VertexStream stream = {};
+  u32 lines_vertex_count = 0;
+  u32 rect_vertex_count = 0;
+  while (buffer->size)
+  {
+    RenderEntryType *type = pop_buffer(buffer, RenderEntryType);
+    RenderEntryRef ref;
+    ref.type = *type;
+    ref.first_vertex = 0;
+    switch (*type)
+    {
+      case RenderEntryType_Rect:
+      {
+        RenderEntryRect *entry = pop_buffer(buffer, RenderEntryRect);
+        ref.entry = entry;
+        rect_vertex_count += entry->shape.count;
+      } break;
+      
+      case RenderEntryType_Quads:
+      {
+        RenderEntryQuads *entry = pop_buffer(buffer, RenderEntryQuads);
+        ref.entry = entry;
+        rect_vertex_count += entry->quad_count*4;
+      } break;
+      
+      case RenderEntryType_ShapeRect:
+      {
+        RenderEntryShapeRect *entry = pop_buffer(buffer, RenderEntryShapeRect);
+        Shape *shape = get_shape(group->shapes, entry->shape);
+        ref.entry = entry;
+        ref.first_vertex = push_vertex_stream(&stream, shape->vertex_x, shape->vertex_y, 4,
+                                              group_m*transform_to_m2x3(entry->t));
+        rect_vertex_count += 4;
+      } break;
+      
+      case RenderEntryType_Shape:
+      {
+        RenderEntryShape *entry = pop_buffer(buffer, RenderEntryShape);
+        Shape *shape = get_shape(group->shapes, entry->shape);
+        ref.entry = entry;
+        ref.first_vertex = push_vertex_stream(&stream, shape->vertex_x, shape->vertex_y,
+                                              shape->padded_count,
+                                              group_m*transform_to_m2x3(entry->t));
+        lines_vertex_count += shape->count;
+      } break;
+      
+      case RenderEntryType_Polygon:
+      {
+        RenderEntryPolygon *entry = pop_buffer(buffer, RenderEntryPolygon);
+        ref.entry = entry;
+        lines_vertex_count += entry->shape.count;
+      } break;
+      
+      invalid_default_case();
+    }
+    sb_push(refs, ref);
+  }
+  transform_vertex_stream(&stream);
+  
   VertexInfo *lines_vertex_infos = 0;
-  sb_reserve(lines_vertex_infos, 200);
+  sb_reserve(lines_vertex_infos, lines_vertex_count + 1);
   
   u32 *lines_indices = 0;
-  sb_reserve(lines_indices, 400);
+  sb_reserve(lines_indices, lines_vertex_count*2 + 1);
   
   
   VertexInfo *rect_vertex_infos = 0;
-  sb_reserve(rect_vertex_infos, 300);
+  sb_reserve(rect_vertex_infos, rect_vertex_count + 1);
   
   u32 *rect_indices = 0;
-  sb_reserve(rect_indices, 1200);
-  
-  Buffer *buffer = &group->buffer;
+  sb_reserve(rect_indices, rect_vertex_count/4*6 + 1);
   
-  while (buffer->size)
+  for (u32 ref_index = 0; ref_index < sb_count(refs); ref_index++)
   {
-    RenderEntryType *type = pop_buffer(buffer, RenderEntryType);
-    switch (*type)
+    RenderEntryRef *ref = refs + ref_index;
+    switch (ref->type)
     {
       case RenderEntryType_Rect:
       {
-        RenderEntryRect *entry =  pop_buffer(buffer, RenderEntryRect);
+        RenderEntryRect *entry = (RenderEntryRect *)ref->entry;
         
         u32 start_index = sb_count(rect_vertex_infos);
         u32 vertex_index = 0;
@@ -248,9 +572,88 @@ void draw_render_group(RenderGroup *group, u32 shader)
         
       } break;
       
+      case RenderEntryType_Quads:
+      {
+        RenderEntryQuads *entry = (RenderEntryQuads *)ref->entry;
+        
+        u32 start_index = sb_count(rect_vertex_infos);
+        VertexInfo *infos = sb_add(rect_vertex_infos, entry->quad_count*4);
+        u32 *indices = sb_add(rect_indices, entry->quad_count*6);
+        
+        for (u32 quad_index = 0;
+             quad_index < entry->quad_count;
+             quad_index++)
+        {
+          for (u32 corner_index = 0; corner_index < 4; corner_index++)
+          {
+            VertexInfo *info = infos + quad_index*4 + corner_index;
+            info->p = entry->vertices[quad_index*4 + corner_index];
+            info->color = entry->color;
+          }
+          
+          u32 first_index = start_index + quad_index*4;
+          u32 *quad_indices = indices + quad_index*6;
+          quad_indices[0] = first_index + 0;
+          quad_indices[1] = first_index + 1;
+          quad_indices[2] = first_index + 2;
+          quad_indices[3] = first_index + 2;
+          quad_indices[4] = first_index + 3;
+          quad_indices[5] = first_index + 0;
+        }
+      } break;
+      
+      case RenderEntryType_ShapeRect:
+      {
+        RenderEntryShapeRect *entry = (RenderEntryShapeRect *)ref->entry;
+        f32 *x = stream.x + ref->first_vertex;
+        f32 *y = stream.y + ref->first_vertex;
+        
+        u32 start_index = sb_count(rect_vertex_infos);
+        VertexInfo *infos = sb_add(rect_vertex_infos, 4);
+        for (u32 vertex_index = 0; vertex_index < 4; vertex_index++)
+        {
+          infos[vertex_index].p = v2(x[vertex_index], y[vertex_index]);
+          infos[vertex_index].color = entry->color;
+        }
+        
+        sb_push(rect_indices, start_index+0);
+        sb_push(rect_indices, start_index+1);
+        sb_push(rect_indices, start_index+2);
+        sb_push(rect_indices, start_index+2);
+        sb_push(rect_indices, start_index+3);
+        sb_push(rect_indices, start_index+0);
+      } break;
+      
+      case RenderEntryType_Shape:
+      {
+        RenderEntryShape *entry = (RenderEntryShape *)ref->entry;
+        Shape *shape = get_shape(group->shapes, entry->shape);
+        f32 *x = stream.x + ref->first_vertex;
+        f32 *y = stream.y + ref->first_vertex;
+        
+        u32 start_index = sb_count(lines_vertex_infos);
+        VertexInfo *infos = sb_add(lines_vertex_infos, shape->count);
+        u32 *indices = sb_add(lines_indices, shape->count*2);
+        for (u32 vertex_index = 0;
+             vertex_index < shape->count;
+             vertex_index++)
+        {
+          infos[vertex_index].p = v2(x[vertex_index], y[vertex_index]);
+          infos[vertex_index].color = entry->color;
+          
+          u32 next_vertex_index = vertex_index + 1;
+          if (next_vertex_index == shape->count)
+          {
+            next_vertex_index = 0;
+          }
+          indices[vertex_index*2 + 0] = start_index + vertex_index;
+          indices[vertex_index*2 + 1] = start_index + next_vertex_index;
+        }
+      } break;
+      
       case RenderEntryType_Polygon:
       {
-        RenderEntryPolygon *entry = pop_buffer(buffer, RenderEntryPolygon);
+        RenderEntryPolygon *entry = (RenderEntryPolygon *)ref->entry;
         
         u32 start_index = sb_count(lines_vertex_infos);
         for (u32 vertex_index = 0;
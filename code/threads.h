@@ -1,87 +1,502 @@
+#ifndef THREADS_H
+#define THREADS_H
 
-#define WORKER_FN(name) void *name(void *data)
-typedef WORKER_FN(WorkerFn);
+#include "platform.h"
+
+#pragma push_macro("swap")
+#undef swap
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#pragma pop_macro("swap")
+#include <emmintrin.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/*
+bounded multi-producer/multi-consumer ring. Every entry carries a sequence
+number that says whose turn it is:
+  sequence == position      the producer that claims position may write it
+  sequence == position + 1  the consumer that claims position may run it
+Producers and consumers claim positions with a compare exchange on their
+cursor, the entry itself is handed over by the release store of its
+sequence, so any thread can add work and any thread can take it.
+When the ring is full AddEntry runs entries itself until a slot frees up.
+*/
+
+#define WORK_QUEUE_SIZE 256
 
 struct WorkQueueEntry
 {
-  void *data;
+  std::atomic<u32> sequence;
   WorkerFn *workerFn;
+  void *data;
+  JobCounter *counter;
 };
 
 struct WorkQueue
 {
-  WorkQueueEntry entries[128];
-  u32 volatile writeCursor;
-  u32 volatile readCursor;
+  WorkQueueEntry entries[WORK_QUEUE_SIZE];
   
-  u32 volatile addedCount;
-  u32 volatile completedCount;
-  
-  HANDLE semaphore;
+  // NOTE(lvl5): separate cache lines so producers and consumers don't
+  // fight over the same one
+  alignas(64) std::atomic<u32> writeCursor;
+  alignas(64) std::atomic<u32> readCursor;
 };
 
-void AddEntry(WorkQueue *queue, WorkerFn *workerFn, void *data)
+void FinishJob(JobCounter *counter)
+{
+  if (counter)
+  {
+    counter->pending.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void InitWorkQueue(WorkQueue *queue)
+{
+  for (u32 entry_index = 0; entry_index < WORK_QUEUE_SIZE; entry_index++)
+  {
+    queue->entries[entry_index].sequence.store(entry_index, std::memory_order_relaxed);
+  }
+  queue->writeCursor.store(0, std::memory_order_relaxed);
+  queue->readCursor.store(0, std::memory_order_relaxed);
+}
+
+b32 TryAddEntry(WorkQueue *queue, WorkerFn *workerFn, void *data, JobCounter *counter)
 {
-  u32 originalWriteCursor = queue->writeCursor;
-  u32 newWriteCursor = (originalWriteCursor + 1) % ArrayCount(queue->entries);
-  WorkQueueEntry *entry = queue->entries + queue->writeCursor;
+  u32 position = queue->writeCursor.load(std::memory_order_relaxed);
+  WorkQueueEntry *entry;
+  while (true)
+  {
+    entry = queue->entries + (position & (WORK_QUEUE_SIZE - 1));
+    u32 sequence = entry->sequence.load(std::memory_order_acquire);
+    i32 diff = (i32)(sequence - position);
+    if (diff == 0)
+    {
+      if (queue->writeCursor.compare_exchange_weak(position, position + 1,
+                                                   std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      // NOTE(lvl5): the entry from the previous lap hasn't been taken yet
+      return false;
+    }
+    else
+    {
+      position = queue->writeCursor.load(std::memory_order_relaxed);
+    }
+  }
+  
   entry->workerFn = workerFn;
   entry->data = data;
-  
-  queue->addedCount++;
-  queue->writeCursor = newWriteCursor;
+  entry->counter = counter;
+  entry->sequence.store(position + 1, std::memory_order_release);
+  return true;
 }
 
 b32 DoTopEntry(WorkQueue *queue)
 {
-  u32 originalReadCursor = queue->readCursor;
-  if (originalReadCursor == queue->writeCursor)
+  u32 position = queue->readCursor.load(std::memory_order_relaxed);
+  WorkQueueEntry *entry;
+  while (true)
   {
-    return false;
+    entry = queue->entries + (position & (WORK_QUEUE_SIZE - 1));
+    u32 sequence = entry->sequence.load(std::memory_order_acquire);
+    i32 diff = (i32)(sequence - (position + 1));
+    if (diff == 0)
+    {
+      if (queue->readCursor.compare_exchange_weak(position, position + 1,
+                                                  std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      return false;
+    }
+    else
+    {
+      position = queue->readCursor.load(std::memory_order_relaxed);
+    }
+  }
+  
+  WorkerFn *workerFn = entry->workerFn;
+  void *data = entry->data;
+  JobCounter *counter = entry->counter;
+  entry->sequence.store(position + WORK_QUEUE_SIZE, std::memory_order_release);
+  
+  workerFn(data);
+  FinishJob(counter);
+  return true;
+}
+
+b32 QueueLooksEmpty(WorkQueue *queue)
+{
+  b32 result = queue->readCursor.load() == queue->writeCursor.load();
+  return result;
+}
+
+void AddEntry(WorkQueue *queue, WorkerFn *workerFn, void *data, JobCounter *counter)
+{
+  while (!TryAddEntry(queue, workerFn, data, counter))
+  {
+    if (!DoTopEntry(queue))
+    {
+      _mm_pause();
+    }
   }
+}
+
+
+/*
+work stealing (Chase-Lev). Every thread in the JobSystem owns a deque: it
+pushes and takes jobs at the bottom without contention, other threads steal
+the oldest jobs from the top when they run dry. Only the owner writes
+bottom, top only ever moves forward through a compare exchange, so the one
+race left is between the owner taking and a thief stealing the very last
+job, and the compare exchange on top settles it.
+Threads that aren't part of the system (or whose deque is full) go through
+the shared WorkQueue instead.
+Waiting on a counter runs other jobs until it drops to zero, workers with
+nothing to do at all sleep on a condition variable.
+*/
+
+#define JOB_DEQUE_SIZE 1024
+
+// NOTE(lvl5): fields are atomic because a thief reads an entry before it
+// knows whether it won it, the owner may be rewriting it at that point
+struct JobDequeEntry
+{
+  std::atomic<WorkerFn *> workerFn;
+  std::atomic<void *> data;
+  std::atomic<JobCounter *> counter;
+};
+
+struct Job
+{
+  WorkerFn *workerFn;
+  void *data;
+  JobCounter *counter;
+};
+
+struct JobDeque
+{
+  alignas(64) std::atomic<u32> top;
+  alignas(64) std::atomic<u32> bottom;
+  JobDequeEntry entries[JOB_DEQUE_SIZE];
+};
+
+struct JobWorker
+{
+  JobDeque deque;
+  JobSystem *system;
+  u32 index;
+  u32 stealSeed;
+};
+
+struct JobSystem
+{
+  JobWorker *workers;
+  u32 workerCount;
+  
+  WorkQueue injected;
   
-  u32 newReadCursor = (originalReadCursor + 1) % ArrayCount(queue->entries);
-  u32 entryIndex = InterlockedCompareExchange(&queue->readCursor,
-                                              newReadCursor,
-                                              originalReadCursor);
-  if (entryIndex == originalReadCursor)
+  alignas(64) std::atomic<u32> sleeperCount;
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+};
+
+thread_local JobWorker *currentJobWorker = 0;
+
+void WriteJobDequeEntry(JobDequeEntry *entry, Job job)
+{
+  entry->workerFn.store(job.workerFn, std::memory_order_relaxed);
+  entry->data.store(job.data, std::memory_order_relaxed);
+  entry->counter.store(job.counter, std::memory_order_relaxed);
+}
+
+Job ReadJobDequeEntry(JobDequeEntry *entry)
+{
+  Job result;
+  result.workerFn = entry->workerFn.load(std::memory_order_relaxed);
+  result.data = entry->data.load(std::memory_order_relaxed);
+  result.counter = entry->counter.load(std::memory_order_relaxed);
+  return result;
+}
+
+// NOTE(lvl5): owner only
+b32 JobDequePush(JobDeque *deque, Job job)
+{
+  u32 bottom = deque->bottom.load(std::memory_order_relaxed);
+  u32 top = deque->top.load(std::memory_order_acquire);
+  if ((i32)(bottom - top) >= JOB_DEQUE_SIZE)
   {
-    WorkQueueEntry *entry = queue->entries + entryIndex;
-    entry->workerFn(entry->data);
-    InterlockedIncrement(&queue->completedCount);
+    return false;
   }
   
+  WriteJobDequeEntry(deque->entries + (bottom & (JOB_DEQUE_SIZE - 1)), job);
+  std::atomic_thread_fence(std::memory_order_release);
+  deque->bottom.store(bottom + 1, std::memory_order_relaxed);
   return true;
 }
 
-void CompleteAllEntries(WorkQueue *queue)
+// NOTE(lvl5): owner only, newest job first
+b32 JobDequeTake(JobDeque *deque, Job *job)
 {
-  while (queue->completedCount != queue->addedCount)
+  u32 bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+  deque->bottom.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  u32 top = deque->top.load(std::memory_order_relaxed);
+  
+  b32 result = false;
+  i32 size = (i32)(bottom - top);
+  if (size >= 0)
   {
-    DoTopEntry(queue);
+    *job = ReadJobDequeEntry(deque->entries + (bottom & (JOB_DEQUE_SIZE - 1)));
+    result = true;
+    if (size == 0)
+    {
+      // NOTE(lvl5): last one, race the thieves for it
+      if (!deque->top.compare_exchange_strong(top, top + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed))
+      {
+        result = false;
+      }
+      deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
   }
+  else
+  {
+    deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return result;
+}
+
+// NOTE(lvl5): any thread, oldest job first. Can fail when another thread got
+// there first even though the deque isn't empty
+b32 JobDequeSteal(JobDeque *deque, Job *job)
+{
+  u32 top = deque->top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  u32 bottom = deque->bottom.load(std::memory_order_acquire);
   
-  queue->addedCount = 0;
-  queue->completedCount = 0;
+  b32 result = false;
+  if ((i32)(bottom - top) > 0)
+  {
+    *job = ReadJobDequeEntry(deque->entries + (top & (JOB_DEQUE_SIZE - 1)));
+    result = deque->top.compare_exchange_strong(top, top + 1,
+                                                std::memory_order_seq_cst,
+                                                std::memory_order_relaxed);
+  }
+  return result;
 }
 
-struct ThreadInfo
+b32 JobDequeLooksEmpty(JobDeque *deque)
 {
-  WorkQueue *queue;
-};
+  u32 top = deque->top.load();
+  u32 bottom = deque->bottom.load();
+  b32 result = (i32)(bottom - top) <= 0;
+  return result;
+}
 
-DWORD WINAPI ThreadProc(void *lpParameter)
+void RunJob(Job job)
+{
+  job.workerFn(job.data);
+  FinishJob(job.counter);
+}
+
+b32 TryRunJob(JobSystem *system, JobWorker *worker)
 {
-  ThreadInfo *info = (ThreadInfo *)lpParameter;
+  Job job;
+  if (worker && JobDequeTake(&worker->deque, &job))
+  {
+    RunJob(job);
+    return true;
+  }
   
-  while (true)
+  if (DoTopEntry(&system->injected))
   {
-    b32 didTopEntry = DoTopEntry(info->queue);
-    if (!didTopEntry)
+    return true;
+  }
+  
+  // NOTE(lvl5): start at a random victim so thieves spread out
+  u32 start = 0;
+  if (worker)
+  {
+    worker->stealSeed ^= worker->stealSeed << 13;
+    worker->stealSeed ^= worker->stealSeed >> 17;
+    worker->stealSeed ^= worker->stealSeed << 5;
+    start = worker->stealSeed;
+  }
+  for (u32 offset = 0; offset < system->workerCount; offset++)
+  {
+    JobWorker *victim = system->workers + (start + offset) % system->workerCount;
+    if (victim != worker && JobDequeSteal(&victim->deque, &job))
     {
-      WaitForSingleObjectEx(info->queue->semaphore, INFINITE, false);
+      RunJob(job);
+      return true;
     }
   }
+  return false;
+}
+
+b32 JobSystemLooksIdle(JobSystem *system)
+{
+  if (!QueueLooksEmpty(&system->injected))
+  {
+    return false;
+  }
+  for (u32 worker_index = 0; worker_index < system->workerCount; worker_index++)
+  {
+    if (!JobDequeLooksEmpty(&system->workers[worker_index].deque))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AddJob(JobSystem *system, WorkerFn *workerFn, void *data, JobCounter *counter)
+{
+  if (counter)
+  {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  
+  Job job;
+  job.workerFn = workerFn;
+  job.data = data;
+  job.counter = counter;
+  
+  JobWorker *worker = currentJobWorker;
+  if (!worker || worker->system != system || !JobDequePush(&worker->deque, job))
+  {
+    AddEntry(&system->injected, workerFn, data, counter);
+  }
   
+  // NOTE(lvl5): pairs with the fence in JobWorkerLoop, either the worker
+  // sees the new job before it sleeps or we see the sleeper here
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (system->sleeperCount.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> lock(system->sleepMutex);
+    system->wakeUp.notify_one();
+  }
+}
+
+void WaitForCounter(JobSystem *system, JobCounter *counter)
+{
+  JobWorker *worker = currentJobWorker;
+  if (worker && worker->system != system)
+  {
+    worker = 0;
+  }
+  
+  while (counter->pending.load(std::memory_order_acquire))
+  {
+    // NOTE(lvl5): nothing to help with means the last jobs are running on
+    // other threads right now
+    if (!TryRunJob(system, worker))
+    {
+      _mm_pause();
+    }
+  }
+}
+
+void JobWorkerLoop(JobWorker *worker)
+{
+  JobSystem *system = worker->system;
+  currentJobWorker = worker;
+  while (true)
+  {
+    if (TryRunJob(system, worker))
+    {
+      continue;
+    }
+    
+    std::unique_lock<std::mutex> lock(system->sleepMutex);
+    system->sleeperCount.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (JobSystemLooksIdle(system))
+    {
+      system->wakeUp.wait(lock);
+    }
+    system->sleeperCount.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+#ifdef _WIN32
+DWORD WINAPI ThreadProc(void *lpParameter)
+{
+  JobWorkerLoop((JobWorker *)lpParameter);
+  return 0;
+}
+#else
+void *ThreadProc(void *parameter)
+{
+  JobWorkerLoop((JobWorker *)parameter);
   return 0;
 }
+#endif
+
+// NOTE(lvl5): system and workers can point at raw memory and have to outlive
+// the threads. workers[0] belongs to the calling thread, a thread is started
+// for each of the others
+void InitJobSystem(JobSystem *system, JobWorker *workers, u32 worker_count)
+{
+  assert(worker_count > 0);
+  new (system) JobSystem();
+  system->workers = workers;
+  system->workerCount = worker_count;
+  InitWorkQueue(&system->injected);
+  system->sleeperCount.store(0, std::memory_order_relaxed);
+  
+  for (u32 worker_index = 0; worker_index < worker_count; worker_index++)
+  {
+    JobWorker *worker = workers + worker_index;
+    new (worker) JobWorker();
+    worker->deque.top.store(0, std::memory_order_relaxed);
+    worker->deque.bottom.store(0, std::memory_order_relaxed);
+    worker->system = system;
+    worker->index = worker_index;
+    worker->stealSeed = 2463534242u + worker_index*2654435761u;
+  }
+  currentJobWorker = workers;
+  std::atomic_thread_fence(std::memory_order_release);
+  
+  for (u32 worker_index = 1; worker_index < worker_count; worker_index++)
+  {
+    JobWorker *worker = workers + worker_index;
+#ifdef _WIN32
+    HANDLE thread = CreateThread(0, 0, ThreadProc, worker, 0, 0);
+    CloseHandle(thread);
+#else
+    pthread_t thread;
+    pthread_create(&thread, 0, ThreadProc, worker);
+    pthread_detach(thread);
+#endif
+  }
+}
+
+void platform_add_job(JobSystem *system, WorkerFn *workerFn, void *data,
+                      JobCounter *counter)
+{
+  AddJob(system, workerFn, data, counter);
+}
+
+void platform_wait_for_counter(JobSystem *system, JobCounter *counter)
+{
+  WaitForCounter(system, counter);
+}
+
+#endif
@@ -237,8 +237,8 @@ LocalContext make_context(LocalContext *parent = 0)
   return result;
 }
 
-#define alloc_struct(T, ...) (T *)alloc(sizeof(T), __VA_ARGS__) 
-#define alloc_array(T, count, ...) (T *)alloc(sizeof(T)*(count), __VA_ARGS__) 
+#define alloc_struct(T, ...) (T *)alloc(sizeof(T), ##__VA_ARGS__) 
+#define alloc_array(T, count, ...) (T *)alloc(sizeof(T)*(count), ##__VA_ARGS__) 
 byte *alloc(u64 size, u32 align)
 {
   LocalContext *ctx = get_local_context();
@@ -263,9 +263,9 @@ ALLOCATOR(temp_allocator)
 }
 
 
-#define temp_alloc_struct(T, ...) (T *)temp_alloc(sizeof(T), __VA_ARGS__) 
+#define temp_alloc_struct(T, ...) (T *)temp_alloc(sizeof(T), ##__VA_ARGS__) 
 #define temp_alloc_array(T, count, ...) \
-(T *)temp_alloc(sizeof(T)*(count), __VA_ARGS__) 
+(T *)temp_alloc(sizeof(T)*(count), ##__VA_ARGS__) 
 void *temp_alloc(u64 size, u32 align = 32)
 {
   void *result = temp_allocator(AllocatorMode_ALLOCATE, size, 0, 0, 0, align);
@@ -368,6 +368,8 @@ struct SbHeader
 #define sb_push(array, item) (sb__maybe_grow(array, 1), (array)[sb__header(array)->count++] = item)
 
 #define sb_reserve(array, n) sb__maybe_grow((array), (n))
+// NOTE(lvl5): grows by n items and returns a pointer to the first new one
+#define sb_add(array, n) (sb__maybe_grow(array, n), sb__header(array)->count += (n), &(array)[sb__header(array)->count - (n)])
 
 
 void *sb__growf(void *array, u32 add_count, u32 item_size)
@@ -688,6 +690,9 @@ f32 sqr(f32 s)
   return result;
 }
 
+// NOTE(lvl5): libstdc++'s math.h already brings the f32 overloads
+// into the global namespace
+#ifdef _MSC_VER
 f32 sqrt(f32 s)
 {
   f32 result = sqrtf(s);
@@ -705,6 +710,7 @@ f32 cos(f32 s)
   f32 result = cosf(s);
   return result;
 }
+#endif
 
 f32 atan(f32 y, f32 x)
 {
@@ -877,17 +883,21 @@ struct v3
     {
       f32 r, g, b;
     };
+#ifdef _MSC_VER
+    // NOTE(lvl5): gcc doesn't allow members with constructors
+    // in anonymous structs
     struct
     {
       v2 xy;
       f32 z;
     };
+#endif
   };
   
   v3() {x = 0; y = 0; z = 0;}
   v3(f32 _x, f32 _y, f32 _z) {x = _x; y = _y; z = _z;}
   v3(i32 _x, i32 _y, i32 _z) {x = (f32)_x; y = (f32)_y; z = (f32)_z;}
-  v3(v2 _xy, f32 _z = 0) {xy = _xy; z = _z;}
+  v3(v2 _xy, f32 _z = 0) {x = _xy.x; y = _xy.y; z = _z;}
 };
 
 v3 operator+(v3 a, v3 b)
@@ -995,6 +1005,7 @@ struct v4
 {
   union
   {
+#ifdef _MSC_VER
     struct
     {
       v3 xyz;
@@ -1011,6 +1022,7 @@ struct v4
       f32 z;
       f32 w;
     };
+#endif
     struct 
     {
       f32 x, y, z, w;
@@ -1028,7 +1040,7 @@ struct v4
     x = (f32)_x; y = (f32)_y;
     z = (f32)_z; w = (f32)_w;
   }
-  v4(v3 _xyz, f32 _w = 0) {xyz = _xyz; w = _w;}
+  v4(v3 _xyz, f32 _w = 0) {x = _xyz.x; y = _xyz.y; z = _xyz.z; w = _w;}
 };
 
 v4 operator+(v4 a, v4 b)
@@ -1203,6 +1215,13 @@ rect2 rescale_centered(rect2 r, v2 scale)
   return result;
 }
 
+b32 intersects(rect2 a, rect2 b)
+{
+  b32 result = a.min.x <= b.max.x && b.min.x <= a.max.x &&
+    a.min.y <= b.max.y && b.min.y <= a.max.y;
+  return result;
+}
+
 // matrix2x2
 
 union m2x2
@@ -1285,6 +1304,69 @@ v2 operator*(m2x2 a, m2x2 b)
   return result;
 }
 
+// matrix2x3
+
+// NOTE(lvl5): a 2d affine transform, c02 and c12 are the translation.
+// Rotation and scale are baked into the rest, so sin and cos are done once
+// when it is made instead of for every vector that goes through it
+union m2x3
+{
+  f32 c[2][3];
+  f32 l[6];
+  struct
+  {
+    f32 c00;
+    f32 c01;
+    f32 c02;
+    f32 c10;
+    f32 c11;
+    f32 c12;
+  };
+  m2x3() {c00 = 0; c01 = 0; c02 = 0; c10 = 0; c11 = 0; c12 = 0;}
+  m2x3(f32 _c00, f32 _c01, f32 _c02, f32 _c10, f32 _c11, f32 _c12)
+  {c00 = _c00; c01 = _c01; c02 = _c02; c10 = _c10; c11 = _c11; c12 = _c12;}
+};
+
+// NOTE(lvl5): scales, then rotates by angle, then moves by p
+m2x3 make_m2x3(v2 p, f32 angle, v2 scale)
+{
+  f32 cos_a = cosf(angle);
+  f32 sin_a = sinf(angle);
+  m2x3 result = m2x3(cos_a*scale.x, -sin_a*scale.y, p.x,
+                     sin_a*scale.x, cos_a*scale.y, p.y);
+  return result;
+}
+
+v2 operator*(m2x3 m, v2 v)
+{
+  v2 result;
+  result.x = m.c00*v.x + m.c01*v.y + m.c02;
+  result.y = m.c10*v.x + m.c11*v.y + m.c12;
+  return result;
+}
+
+// NOTE(lvl5): b goes first, then a
+m2x3 operator*(m2x3 a, m2x3 b)
+{
+  m2x3 result;
+  result.c00 = a.c00*b.c00 + a.c01*b.c10;
+  result.c01 = a.c00*b.c01 + a.c01*b.c11;
+  result.c02 = a.c00*b.c02 + a.c01*b.c12 + a.c02;
+  result.c10 = a.c10*b.c00 + a.c11*b.c10;
+  result.c11 = a.c10*b.c01 + a.c11*b.c11;
+  result.c12 = a.c10*b.c02 + a.c11*b.c12 + a.c12;
+  return result;
+}
+
+// NOTE(lvl5): result can be points
+void transform_points(m2x3 m, v2 *points, v2 *result, u32 count)
+{
+  for (u32 point_index = 0; point_index < count; point_index++)
+  {
+    result[point_index] = m*points[point_index];
+  }
+}
+
 
 // range??
 struct RangeF32
@@ -0,0 +1,1013 @@
+#ifndef WIDE_MATH_H
+#define WIDE_MATH_H
+
+#include "utils.h"
+
+/*
+lane-wide versions of the maths in utils.h, for the code that keeps its data
+as separate x and y arrays. f32x4 and v2x4 are 4 lanes, f32x8 and v2x8 are 8.
+Comparisons give a b32x4 or b32x8 with every lane all ones or all zeros, which
+select blends with.
+
+the backend is picked at compile time:
+  WIDE_MATH_SCALAR defined  plain loops, for checking the others against
+  __AVX2__                  f32x8 is one __m256, f32x4 is __m128
+  SSE2                      f32x4 is __m128, f32x8 is two of them
+anything else falls back to the plain loops too. Every backend does the same
+operations in the same order, so they all give the same bits
+*/
+
+#if defined(WIDE_MATH_SCALAR)
+#elif defined(__AVX2__)
+#define WIDE_MATH_SSE2 1
+#define WIDE_MATH_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIDE_MATH_SSE2 1
+#endif
+
+#if WIDE_MATH_AVX2
+#include <immintrin.h>
+#elif WIDE_MATH_SSE2
+#include <emmintrin.h>
+#endif
+
+
+// NOTE(lvl5): f32x4
+
+#if WIDE_MATH_SSE2
+
+struct b32x4
+{
+  __m128 v;
+};
+
+struct f32x4
+{
+  __m128 v;
+  
+  f32x4() {v = _mm_setzero_ps();}
+  f32x4(f32 s) {v = _mm_set1_ps(s);}
+  f32x4(f32 a, f32 b, f32 c, f32 d) {v = _mm_setr_ps(a, b, c, d);}
+};
+
+f32x4 wrap_f32x4(__m128 v)
+{
+  f32x4 result;
+  result.v = v;
+  return result;
+}
+
+b32x4 wrap_b32x4(__m128 v)
+{
+  b32x4 result;
+  result.v = v;
+  return result;
+}
+
+f32x4 load_f32x4(f32 *src)
+{
+  f32x4 result = wrap_f32x4(_mm_loadu_ps(src));
+  return result;
+}
+
+// NOTE(lvl5): src and dest are 16 byte aligned
+f32x4 load_aligned_f32x4(f32 *src)
+{
+  f32x4 result = wrap_f32x4(_mm_load_ps(src));
+  return result;
+}
+
+void store(f32 *dest, f32x4 a)
+{
+  _mm_storeu_ps(dest, a.v);
+}
+
+void store_aligned(f32 *dest, f32x4 a)
+{
+  _mm_store_ps(dest, a.v);
+}
+
+f32x4 operator+(f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_add_ps(a.v, b.v));
+  return result;
+}
+f32x4 operator-(f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_sub_ps(a.v, b.v));
+  return result;
+}
+f32x4 operator*(f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_mul_ps(a.v, b.v));
+  return result;
+}
+f32x4 operator/(f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_div_ps(a.v, b.v));
+  return result;
+}
+f32x4 operator-(f32x4 a)
+{
+  f32x4 result = wrap_f32x4(_mm_sub_ps(_mm_setzero_ps(), a.v));
+  return result;
+}
+
+b32x4 operator<(f32x4 a, f32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_cmplt_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator<=(f32x4 a, f32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_cmple_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator>(f32x4 a, f32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_cmpgt_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator>=(f32x4 a, f32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_cmpge_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator==(f32x4 a, f32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_cmpeq_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator!=(f32x4 a, f32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_cmpneq_ps(a.v, b.v));
+  return result;
+}
+
+b32x4 operator&(b32x4 a, b32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_and_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator|(b32x4 a, b32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_or_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator^(b32x4 a, b32x4 b)
+{
+  b32x4 result = wrap_b32x4(_mm_xor_ps(a.v, b.v));
+  return result;
+}
+b32x4 operator!(b32x4 a)
+{
+  __m128 all_ones = _mm_castsi128_ps(_mm_set1_epi32(-1));
+  b32x4 result = wrap_b32x4(_mm_xor_ps(a.v, all_ones));
+  return result;
+}
+
+// NOTE(lvl5): bit i is set when lane i is
+u32 get_mask_bits(b32x4 a)
+{
+  u32 result = (u32)_mm_movemask_ps(a.v);
+  return result;
+}
+
+// NOTE(lvl5): a where mask is set, b elsewhere
+f32x4 select(b32x4 mask, f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_or_ps(_mm_and_ps(mask.v, a.v),
+                                      _mm_andnot_ps(mask.v, b.v)));
+  return result;
+}
+
+// NOTE(lvl5): like minps, b when either is NaN
+f32x4 min(f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_min_ps(a.v, b.v));
+  return result;
+}
+f32x4 max(f32x4 a, f32x4 b)
+{
+  f32x4 result = wrap_f32x4(_mm_max_ps(a.v, b.v));
+  return result;
+}
+
+f32x4 sqrt(f32x4 a)
+{
+  f32x4 result = wrap_f32x4(_mm_sqrt_ps(a.v));
+  return result;
+}
+
+f32x4 abs(f32x4 a)
+{
+  f32x4 result = wrap_f32x4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v));
+  return result;
+}
+
+f32 reduce_min(f32x4 a)
+{
+  __m128 v = _mm_min_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+  f32 result = _mm_cvtss_f32(v);
+  return result;
+}
+
+f32 reduce_max(f32x4 a)
+{
+  __m128 v = _mm_max_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+  f32 result = _mm_cvtss_f32(v);
+  return result;
+}
+
+// NOTE(lvl5): lane i of the result is the smallest lane of the i-th
+// argument, four reductions for the price of one
+f32x4 reduce_min(f32x4 a, f32x4 b, f32x4 c, f32x4 d)
+{
+  __m128 ab = _mm_min_ps(_mm_unpacklo_ps(a.v, b.v), _mm_unpackhi_ps(a.v, b.v));
+  __m128 cd = _mm_min_ps(_mm_unpacklo_ps(c.v, d.v), _mm_unpackhi_ps(c.v, d.v));
+  f32x4 result = wrap_f32x4(_mm_min_ps(_mm_movelh_ps(ab, cd),
+                                       _mm_movehl_ps(cd, ab)));
+  return result;
+}
+
+// NOTE(lvl5): dest[lane*4 + i] = (x[i], y[i]) of that lane, so the 4 vectors
+// every lane has end up next to each other
+void store_quads(v2 *dest, f32x4 *x, f32x4 *y)
+{
+  __m128 lo[4];
+  __m128 hi[4];
+  for (u32 i = 0; i < 4; i++)
+  {
+    lo[i] = _mm_unpacklo_ps(x[i].v, y[i].v);
+    hi[i] = _mm_unpackhi_ps(x[i].v, y[i].v);
+  }
+  
+  f32 *d = (f32 *)dest;
+  _mm_storeu_ps(d + 0, _mm_movelh_ps(lo[0], lo[1]));
+  _mm_storeu_ps(d + 4, _mm_movelh_ps(lo[2], lo[3]));
+  _mm_storeu_ps(d + 8, _mm_movehl_ps(lo[1], lo[0]));
+  _mm_storeu_ps(d + 12, _mm_movehl_ps(lo[3], lo[2]));
+  _mm_storeu_ps(d + 16, _mm_movelh_ps(hi[0], hi[1]));
+  _mm_storeu_ps(d + 20, _mm_movelh_ps(hi[2], hi[3]));
+  _mm_storeu_ps(d + 24, _mm_movehl_ps(hi[1], hi[0]));
+  _mm_storeu_ps(d + 28, _mm_movehl_ps(hi[3], hi[2]));
+}
+
+#else
+
+struct b32x4
+{
+  u32 e[4];
+};
+
+struct f32x4
+{
+  f32 e[4];
+  
+  f32x4() {e[0] = 0; e[1] = 0; e[2] = 0; e[3] = 0;}
+  f32x4(f32 s) {e[0] = s; e[1] = s; e[2] = s; e[3] = s;}
+  f32x4(f32 a, f32 b, f32 c, f32 d) {e[0] = a; e[1] = b; e[2] = c; e[3] = d;}
+};
+
+#define WIDE_MATH_LANES_4(expr) for (u32 i = 0; i < 4; i++) {expr;}
+
+f32x4 load_f32x4(f32 *src)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = src[i]);
+  return result;
+}
+
+f32x4 load_aligned_f32x4(f32 *src)
+{
+  assert(((u64)src & 15) == 0);
+  f32x4 result = load_f32x4(src);
+  return result;
+}
+
+void store(f32 *dest, f32x4 a)
+{
+  WIDE_MATH_LANES_4(dest[i] = a.e[i]);
+}
+
+void store_aligned(f32 *dest, f32x4 a)
+{
+  assert(((u64)dest & 15) == 0);
+  store(dest, a);
+}
+
+f32x4 operator+(f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] + b.e[i]);
+  return result;
+}
+f32x4 operator-(f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] - b.e[i]);
+  return result;
+}
+f32x4 operator*(f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i]*b.e[i]);
+  return result;
+}
+f32x4 operator/(f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i]/b.e[i]);
+  return result;
+}
+f32x4 operator-(f32x4 a)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = 0.0f - a.e[i]);
+  return result;
+}
+
+#define WIDE_MATH_COMPARE_4(op) \
+b32x4 result; \
+WIDE_MATH_LANES_4(result.e[i] = a.e[i] op b.e[i] ? U32_MAX : 0); \
+return result;
+
+b32x4 operator<(f32x4 a, f32x4 b) {WIDE_MATH_COMPARE_4(<)}
+b32x4 operator<=(f32x4 a, f32x4 b) {WIDE_MATH_COMPARE_4(<=)}
+b32x4 operator>(f32x4 a, f32x4 b) {WIDE_MATH_COMPARE_4(>)}
+b32x4 operator>=(f32x4 a, f32x4 b) {WIDE_MATH_COMPARE_4(>=)}
+b32x4 operator==(f32x4 a, f32x4 b) {WIDE_MATH_COMPARE_4(==)}
+b32x4 operator!=(f32x4 a, f32x4 b) {WIDE_MATH_COMPARE_4(!=)}
+
+b32x4 operator&(b32x4 a, b32x4 b)
+{
+  b32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] & b.e[i]);
+  return result;
+}
+b32x4 operator|(b32x4 a, b32x4 b)
+{
+  b32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] | b.e[i]);
+  return result;
+}
+b32x4 operator^(b32x4 a, b32x4 b)
+{
+  b32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] ^ b.e[i]);
+  return result;
+}
+b32x4 operator!(b32x4 a)
+{
+  b32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = ~a.e[i]);
+  return result;
+}
+
+u32 get_mask_bits(b32x4 a)
+{
+  u32 result = 0;
+  WIDE_MATH_LANES_4(result |= (a.e[i] >> 31) << i);
+  return result;
+}
+
+f32x4 select(b32x4 mask, f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = mask.e[i] ? a.e[i] : b.e[i]);
+  return result;
+}
+
+f32x4 min(f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] < b.e[i] ? a.e[i] : b.e[i]);
+  return result;
+}
+f32x4 max(f32x4 a, f32x4 b)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = a.e[i] > b.e[i] ? a.e[i] : b.e[i]);
+  return result;
+}
+
+f32x4 sqrt(f32x4 a)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = sqrtf(a.e[i]));
+  return result;
+}
+
+f32x4 abs(f32x4 a)
+{
+  f32x4 result;
+  WIDE_MATH_LANES_4(result.e[i] = fabsf(a.e[i]));
+  return result;
+}
+
+f32 reduce_min(f32x4 a)
+{
+  f32 result = a.e[0];
+  for (u32 i = 1; i < 4; i++)
+  {
+    result = a.e[i] < result ? a.e[i] : result;
+  }
+  return result;
+}
+
+f32 reduce_max(f32x4 a)
+{
+  f32 result = a.e[0];
+  for (u32 i = 1; i < 4; i++)
+  {
+    result = a.e[i] > result ? a.e[i] : result;
+  }
+  return result;
+}
+
+f32x4 reduce_min(f32x4 a, f32x4 b, f32x4 c, f32x4 d)
+{
+  f32x4 result = f32x4(reduce_min(a), reduce_min(b), reduce_min(c), reduce_min(d));
+  return result;
+}
+
+void store_quads(v2 *dest, f32x4 *x, f32x4 *y)
+{
+  for (u32 lane_index = 0; lane_index < 4; lane_index++)
+  {
+    for (u32 i = 0; i < 4; i++)
+    {
+      dest[lane_index*4 + i] = v2(x[i].e[lane_index], y[i].e[lane_index]);
+    }
+  }
+}
+
+#undef WIDE_MATH_COMPARE_4
+#undef WIDE_MATH_LANES_4
+
+#endif
+
+b32 any(b32x4 a)
+{
+  b32 result = get_mask_bits(a) != 0;
+  return result;
+}
+
+b32 all(b32x4 a)
+{
+  b32 result = get_mask_bits(a) == 0xF;
+  return result;
+}
+
+
+// NOTE(lvl5): f32x8
+
+#if WIDE_MATH_AVX2
+
+struct b32x8
+{
+  __m256 v;
+};
+
+struct f32x8
+{
+  __m256 v;
+  
+  f32x8() {v = _mm256_setzero_ps();}
+  f32x8(f32 s) {v = _mm256_set1_ps(s);}
+};
+
+f32x8 wrap_f32x8(__m256 v)
+{
+  f32x8 result;
+  result.v = v;
+  return result;
+}
+
+b32x8 wrap_b32x8(__m256 v)
+{
+  b32x8 result;
+  result.v = v;
+  return result;
+}
+
+f32x4 get_low(f32x8 a)
+{
+  f32x4 result = wrap_f32x4(_mm256_castps256_ps128(a.v));
+  return result;
+}
+
+f32x4 get_high(f32x8 a)
+{
+  f32x4 result = wrap_f32x4(_mm256_extractf128_ps(a.v, 1));
+  return result;
+}
+
+f32x8 load_f32x8(f32 *src)
+{
+  f32x8 result = wrap_f32x8(_mm256_loadu_ps(src));
+  return result;
+}
+
+// NOTE(lvl5): src and dest are 32 byte aligned
+f32x8 load_aligned_f32x8(f32 *src)
+{
+  f32x8 result = wrap_f32x8(_mm256_load_ps(src));
+  return result;
+}
+
+void store(f32 *dest, f32x8 a)
+{
+  _mm256_storeu_ps(dest, a.v);
+}
+
+void store_aligned(f32 *dest, f32x8 a)
+{
+  _mm256_store_ps(dest, a.v);
+}
+
+f32x8 operator+(f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_add_ps(a.v, b.v));
+  return result;
+}
+f32x8 operator-(f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_sub_ps(a.v, b.v));
+  return result;
+}
+f32x8 operator*(f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_mul_ps(a.v, b.v));
+  return result;
+}
+f32x8 operator/(f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_div_ps(a.v, b.v));
+  return result;
+}
+f32x8 operator-(f32x8 a)
+{
+  f32x8 result = wrap_f32x8(_mm256_sub_ps(_mm256_setzero_ps(), a.v));
+  return result;
+}
+
+// NOTE(lvl5): the predicates the SSE compares use, != is true for NaN
+b32x8 operator<(f32x8 a, f32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OS));
+  return result;
+}
+b32x8 operator<=(f32x8 a, f32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OS));
+  return result;
+}
+b32x8 operator>(f32x8 a, f32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OS));
+  return result;
+}
+b32x8 operator>=(f32x8 a, f32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OS));
+  return result;
+}
+b32x8 operator==(f32x8 a, f32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ));
+  return result;
+}
+b32x8 operator!=(f32x8 a, f32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ));
+  return result;
+}
+
+b32x8 operator&(b32x8 a, b32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_and_ps(a.v, b.v));
+  return result;
+}
+b32x8 operator|(b32x8 a, b32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_or_ps(a.v, b.v));
+  return result;
+}
+b32x8 operator^(b32x8 a, b32x8 b)
+{
+  b32x8 result = wrap_b32x8(_mm256_xor_ps(a.v, b.v));
+  return result;
+}
+b32x8 operator!(b32x8 a)
+{
+  __m256 all_ones = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  b32x8 result = wrap_b32x8(_mm256_xor_ps(a.v, all_ones));
+  return result;
+}
+
+u32 get_mask_bits(b32x8 a)
+{
+  u32 result = (u32)_mm256_movemask_ps(a.v);
+  return result;
+}
+
+f32x8 select(b32x8 mask, f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_blendv_ps(b.v, a.v, mask.v));
+  return result;
+}
+
+f32x8 min(f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_min_ps(a.v, b.v));
+  return result;
+}
+f32x8 max(f32x8 a, f32x8 b)
+{
+  f32x8 result = wrap_f32x8(_mm256_max_ps(a.v, b.v));
+  return result;
+}
+
+f32x8 sqrt(f32x8 a)
+{
+  f32x8 result = wrap_f32x8(_mm256_sqrt_ps(a.v));
+  return result;
+}
+
+f32x8 abs(f32x8 a)
+{
+  f32x8 result = wrap_f32x8(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v));
+  return result;
+}
+
+#else
+
+// NOTE(lvl5): two f32x4, lanes 0-3 in lo
+struct b32x8
+{
+  b32x4 lo;
+  b32x4 hi;
+};
+
+struct f32x8
+{
+  f32x4 lo;
+  f32x4 hi;
+  
+  f32x8() {}
+  f32x8(f32 s) {lo = f32x4(s); hi = f32x4(s);}
+};
+
+f32x8 make_f32x8(f32x4 lo, f32x4 hi)
+{
+  f32x8 result;
+  result.lo = lo;
+  result.hi = hi;
+  return result;
+}
+
+b32x8 make_b32x8(b32x4 lo, b32x4 hi)
+{
+  b32x8 result;
+  result.lo = lo;
+  result.hi = hi;
+  return result;
+}
+
+f32x4 get_low(f32x8 a)
+{
+  f32x4 result = a.lo;
+  return result;
+}
+
+f32x4 get_high(f32x8 a)
+{
+  f32x4 result = a.hi;
+  return result;
+}
+
+f32x8 load_f32x8(f32 *src)
+{
+  f32x8 result = make_f32x8(load_f32x4(src), load_f32x4(src + 4));
+  return result;
+}
+
+f32x8 load_aligned_f32x8(f32 *src)
+{
+  assert(((u64)src & 31) == 0);
+  f32x8 result = make_f32x8(load_aligned_f32x4(src), load_aligned_f32x4(src + 4));
+  return result;
+}
+
+void store(f32 *dest, f32x8 a)
+{
+  store(dest, a.lo);
+  store(dest + 4, a.hi);
+}
+
+void store_aligned(f32 *dest, f32x8 a)
+{
+  assert(((u64)dest & 31) == 0);
+  store_aligned(dest, a.lo);
+  store_aligned(dest + 4, a.hi);
+}
+
+#define WIDE_MATH_SPLIT_8(T, make, expr) \
+T result = make(expr(a.lo, b.lo), expr(a.hi, b.hi)); \
+return result;
+
+f32x8 operator+(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(f32x8, make_f32x8, operator+)}
+f32x8 operator-(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(f32x8, make_f32x8, operator-)}
+f32x8 operator*(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(f32x8, make_f32x8, operator*)}
+f32x8 operator/(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(f32x8, make_f32x8, operator/)}
+f32x8 operator-(f32x8 a)
+{
+  f32x8 result = make_f32x8(-a.lo, -a.hi);
+  return result;
+}
+
+b32x8 operator<(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator<)}
+b32x8 operator<=(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator<=)}
+b32x8 operator>(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator>)}
+b32x8 operator>=(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator>=)}
+b32x8 operator==(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator==)}
+b32x8 operator!=(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator!=)}
+
+b32x8 operator&(b32x8 a, b32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator&)}
+b32x8 operator|(b32x8 a, b32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator|)}
+b32x8 operator^(b32x8 a, b32x8 b) {WIDE_MATH_SPLIT_8(b32x8, make_b32x8, operator^)}
+b32x8 operator!(b32x8 a)
+{
+  b32x8 result = make_b32x8(!a.lo, !a.hi);
+  return result;
+}
+
+u32 get_mask_bits(b32x8 a)
+{
+  u32 result = get_mask_bits(a.lo) | (get_mask_bits(a.hi) << 4);
+  return result;
+}
+
+f32x8 select(b32x8 mask, f32x8 a, f32x8 b)
+{
+  f32x8 result = make_f32x8(select(mask.lo, a.lo, b.lo),
+                            select(mask.hi, a.hi, b.hi));
+  return result;
+}
+
+f32x8 min(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(f32x8, make_f32x8, min)}
+f32x8 max(f32x8 a, f32x8 b) {WIDE_MATH_SPLIT_8(f32x8, make_f32x8, max)}
+
+f32x8 sqrt(f32x8 a)
+{
+  f32x8 result = make_f32x8(sqrt(a.lo), sqrt(a.hi));
+  return result;
+}
+
+f32x8 abs(f32x8 a)
+{
+  f32x8 result = make_f32x8(abs(a.lo), abs(a.hi));
+  return result;
+}
+
+#undef WIDE_MATH_SPLIT_8
+
+#endif
+
+b32 any(b32x8 a)
+{
+  b32 result = get_mask_bits(a) != 0;
+  return result;
+}
+
+b32 all(b32x8 a)
+{
+  b32 result = get_mask_bits(a) == 0xFF;
+  return result;
+}
+
+f32 reduce_min(f32x8 a)
+{
+  f32 result = reduce_min(min(get_low(a), get_high(a)));
+  return result;
+}
+
+f32 reduce_max(f32x8 a)
+{
+  f32 result = reduce_max(max(get_low(a), get_high(a)));
+  return result;
+}
+
+void store_quads(v2 *dest, f32x8 *x, f32x8 *y)
+{
+  f32x4 lo_x[4] = {get_low(x[0]), get_low(x[1]), get_low(x[2]), get_low(x[3])};
+  f32x4 lo_y[4] = {get_low(y[0]), get_low(y[1]), get_low(y[2]), get_low(y[3])};
+  f32x4 hi_x[4] = {get_high(x[0]), get_high(x[1]), get_high(x[2]), get_high(x[3])};
+  f32x4 hi_y[4] = {get_high(y[0]), get_high(y[1]), get_high(y[2]), get_high(y[3])};
+  store_quads(dest, lo_x, lo_y);
+  store_quads(dest + 16, hi_x, hi_y);
+}
+
+
+// NOTE(lvl5): v2x4 and v2x8, lane i of x and y is one v2. The same for both
+// widths, written on top of the operations above
+template <typename F>
+struct v2_lanes
+{
+  F x, y;
+  
+  v2_lanes() {}
+  v2_lanes(F _x, F _y) {x = _x; y = _y;}
+  v2_lanes(v2 v) {x = F(v.x); y = F(v.y);}
+};
+
+typedef v2_lanes<f32x4> v2x4;
+typedef v2_lanes<f32x8> v2x8;
+
+v2x4 load_v2x4(f32 *x, f32 *y)
+{
+  v2x4 result = v2x4(load_f32x4(x), load_f32x4(y));
+  return result;
+}
+
+v2x4 load_aligned_v2x4(f32 *x, f32 *y)
+{
+  v2x4 result = v2x4(load_aligned_f32x4(x), load_aligned_f32x4(y));
+  return result;
+}
+
+v2x8 load_v2x8(f32 *x, f32 *y)
+{
+  v2x8 result = v2x8(load_f32x8(x), load_f32x8(y));
+  return result;
+}
+
+v2x8 load_aligned_v2x8(f32 *x, f32 *y)
+{
+  v2x8 result = v2x8(load_aligned_f32x8(x), load_aligned_f32x8(y));
+  return result;
+}
+
+template <typename F>
+void store(f32 *x, f32 *y, v2_lanes<F> v)
+{
+  store(x, v.x);
+  store(y, v.y);
+}
+
+template <typename F>
+void store_aligned(f32 *x, f32 *y, v2_lanes<F> v)
+{
+  store_aligned(x, v.x);
+  store_aligned(y, v.y);
+}
+
+template <typename F>
+v2_lanes<F> operator+(v2_lanes<F> a, v2_lanes<F> b)
+{
+  v2_lanes<F> result = v2_lanes<F>(a.x + b.x, a.y + b.y);
+  return result;
+}
+template <typename F>
+v2_lanes<F>& operator+=(v2_lanes<F>& a, v2_lanes<F> b)
+{
+  a = a + b;
+  return a;
+}
+template <typename F>
+v2_lanes<F> operator-(v2_lanes<F> a, v2_lanes<F> b)
+{
+  v2_lanes<F> result = v2_lanes<F>(a.x - b.x, a.y - b.y);
+  return result;
+}
+template <typename F>
+v2_lanes<F>& operator-=(v2_lanes<F>& a, v2_lanes<F> b)
+{
+  a = a - b;
+  return a;
+}
+template <typename F>
+v2_lanes<F> operator*(v2_lanes<F> a, F s)
+{
+  v2_lanes<F> result = v2_lanes<F>(a.x*s, a.y*s);
+  return result;
+}
+template <typename F>
+v2_lanes<F> operator*(F s, v2_lanes<F> a)
+{
+  v2_lanes<F> result = a*s;
+  return result;
+}
+template <typename F>
+v2_lanes<F> operator*(v2_lanes<F> a, f32 s)
+{
+  v2_lanes<F> result = a*F(s);
+  return result;
+}
+template <typename F>
+v2_lanes<F> operator*(f32 s, v2_lanes<F> a)
+{
+  v2_lanes<F> result = a*F(s);
+  return result;
+}
+template <typename F>
+v2_lanes<F>& operator*=(v2_lanes<F>& a, F s)
+{
+  a = a*s;
+  return a;
+}
+template <typename F>
+v2_lanes<F> operator-(v2_lanes<F> a)
+{
+  v2_lanes<F> result = v2_lanes<F>(-a.x, -a.y);
+  return result;
+}
+
+template <typename F>
+F dot(v2_lanes<F> a, v2_lanes<F> b)
+{
+  F result = a.x*b.x + a.y*b.y;
+  return result;
+}
+
+template <typename F>
+v2_lanes<F> hadamard(v2_lanes<F> a, v2_lanes<F> b)
+{
+  v2_lanes<F> result = v2_lanes<F>(a.x*b.x, a.y*b.y);
+  return result;
+}
+
+// NOTE(lvl5): every lane by the same angle
+template <typename F>
+v2_lanes<F> rotate(v2_lanes<F> v, f32 a)
+{
+  F sin_a = F(sinf(a));
+  F cos_a = F(cosf(a));
+  v2_lanes<F> result = v2_lanes<F>(cos_a*v.x - sin_a*v.y,
+                                   sin_a*v.x + cos_a*v.y);
+  return result;
+}
+
+template <typename F>
+F len_sqr(v2_lanes<F> v)
+{
+  F result = dot(v, v);
+  return result;
+}
+
+template <typename F>
+F len(v2_lanes<F> v)
+{
+  F result = sqrt(len_sqr(v));
+  return result;
+}
+
+// NOTE(lvl5): zero length lanes come out zero, like safe_ratio0
+template <typename F>
+v2_lanes<F> normalize(v2_lanes<F> v)
+{
+  F length = len(v);
+  F zero = F(0.0f);
+  v2_lanes<F> result = v2_lanes<F>(select(length != zero, v.x/length, zero),
+                                   select(length != zero, v.y/length, zero));
+  return result;
+}
+
+template <typename F>
+v2_lanes<F> perp(v2_lanes<F> v)
+{
+  v2_lanes<F> result = v2_lanes<F>(-v.y, v.x);
+  return result;
+}
+
+template <typename M, typename F>
+v2_lanes<F> select(M mask, v2_lanes<F> a, v2_lanes<F> b)
+{
+  v2_lanes<F> result = v2_lanes<F>(select(mask, a.x, b.x),
+                                   select(mask, a.y, b.y));
+  return result;
+}
+
+// NOTE(lvl5): the same order of operations as m2x3 * v2, so a lane comes out
+// the same as the scalar one
+template <typename F>
+v2_lanes<F> operator*(m2x3 m, v2_lanes<F> v)
+{
+  v2_lanes<F> result = v2_lanes<F>(F(m.c00)*v.x + F(m.c01)*v.y + F(m.c02),
+                                   F(m.c10)*v.x + F(m.c11)*v.y + F(m.c12));
+  return result;
+}
+
+template <typename F>
+void store_quads(v2 *dest, v2_lanes<F> *v)
+{
+  F x[4] = {v[0].x, v[1].x, v[2].x, v[3].x};
+  F y[4] = {v[0].y, v[1].y, v[2].y, v[3].y};
+  store_quads(dest, x, y);
+}
+
+
+#endif
@@ -4,6 +4,7 @@
 #include <xaudio2.h>
 #include <Windows.h>
 #include "KHR/wglext.h"
+#include "threads.h"
 
 
 
@@ -168,6 +169,17 @@ void win32_handle_button(Button *b, b32 new_is_down)
   b->is_down = new_is_down;
 }
 
+u64 platform_get_nanoseconds()
+{
+  LARGE_INTEGER time_li;
+  QueryPerformanceCounter(&time_li);
+  u64 seconds = time_li.QuadPart/global_counts_per_second;
+  u64 remainder = time_li.QuadPart%global_counts_per_second;
+  u64 result = seconds*1000000000ULL + 
+    remainder*1000000000ULL/global_counts_per_second;
+  return result;
+}
+
 f32 win32_get_time()
 {
   LARGE_INTEGER time_li;
@@ -458,6 +470,15 @@ int CALLBACK WinMain(HINSTANCE instance,
   game_memory.size = megabytes(128);
   game_memory.data = alloc(game_memory.size);
   
+  SYSTEM_INFO system_info;
+  GetSystemInfo(&system_info);
+  u32 worker_thread_count = system_info.dwNumberOfProcessors - 1;
+  JobSystem *job_system = alloc_struct(JobSystem, alignof(JobSystem));
+  JobWorker *job_workers = alloc_array(JobWorker, worker_thread_count + 1,
+                                       alignof(JobWorker));
+  InitJobSystem(job_system, job_workers, worker_thread_count + 1);
+  game_memory.job_system = job_system;
+  
   GameInput game_input = {};
   
   GameScreen game_screen;